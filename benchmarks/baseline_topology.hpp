@@ -0,0 +1,14 @@
+// Generated by: router --emit-topology configs/baseline.json
+// Build with -DROUTER_STATIC_TOPOLOGY='"<this header>"'.
+#pragma once
+
+struct GeneratedTopology {
+    static constexpr const char* source = "configs/baseline.json";
+    static constexpr IngressTopology ingress = IngressTopology::Lanes;
+    static constexpr int producer_count = 4;
+    static constexpr int processor_count = 4;
+    static constexpr int strategy_count = 3;
+    static constexpr std::array<int, MAX_MSG_TYPES> fixed_processor = {0, 1, 2, 3, 0, 0, 0, 0};
+    static constexpr std::array<int, MAX_MSG_TYPES> stage2 = {0, 1, 2, 0, 0, 0, 0, 0};
+    static constexpr std::array<bool, MAX_MSG_TYPES> ordered = {true, true, true, true, false, false, false, false};
+};
@@ -7,50 +7,27 @@
 #include <new>         // for std::nothrow
 #include <memory>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "../include/router/payload_pool.hpp"
+#include "../include/router/queues.hpp"
 
 // =====================================
 // Simple message structure (heap-heavy)
 // =====================================
-struct Message {
+struct HeapMessage {
     std::vector<uint8_t> payload;
-    Message(size_t size) : payload(size, 0xAB) {}
+    HeapMessage(size_t size) : payload(size, 0xAB) {}
 };
 
-// =====================================
-// Lock-free Single Producer Single Consumer Queue (simplified)
-// =====================================
-template <typename T, size_t Capacity>
-class SPSCQueue {
-public:
-    SPSCQueue() : head_(0), tail_(0) {
-        buffer_.resize(Capacity);
-    }
-
-    bool push(std::unique_ptr<T> item) {
-        size_t head = head_.load(std::memory_order_relaxed);
-        size_t next = (head + 1) % Capacity;
-        if (next == tail_.load(std::memory_order_acquire)) {
-            return false; // full
-        }
-        buffer_[head] = std::move(item);
-        head_.store(next, std::memory_order_release);
-        return true;
-    }
-
-    bool pop(std::unique_ptr<T>& item) {
-        size_t tail = tail_.load(std::memory_order_relaxed);
-        if (tail == head_.load(std::memory_order_acquire)) {
-            return false; // empty
-        }
-        item = std::move(buffer_[tail]);
-        tail_.store((tail + 1) % Capacity, std::memory_order_release);
-        return true;
-    }
+// SPSCQueue and PayloadPool are the router's own (include/router).
+constexpr size_t QUEUE_SLOTS = 1 << 16;
 
-private:
-    std::vector<std::unique_ptr<T>> buffer_;
-    std::atomic<size_t> head_;
-    std::atomic<size_t> tail_;
+struct PayloadHandle {
+    uint32_t slot;
+    uint32_t bytes;
 };
 
 // =====================================
@@ -78,15 +55,16 @@ static void BM_MemoryAllocation_SPSCQueue(benchmark::State& state) {
     const size_t payload_size = state.range(0);
     const size_t queue_capacity = state.range(1);
 
-    SPSCQueue<Message, 1 << 16> queue;
+    // Owning pointers: the consumer frees what it pops.
+    SPSCQueue<HeapMessage*> queue{QueueSpec{QUEUE_SLOTS}};
     std::atomic<bool> stop_flag{false};
     std::atomic<size_t> produced{0}, consumed{0};
 
     std::thread producer([&]() {
-        std::mt19937 gen(42);
         while (!stop_flag.load()) {
-            auto msg = std::make_unique<Message>(payload_size);
-            if (queue.push(std::move(msg))) {
+            auto msg = std::make_unique<HeapMessage>(payload_size);
+            if (queue.push(msg.get())) {
+                msg.release();
                 produced++;
             } else {
                 std::this_thread::yield();
@@ -95,14 +73,86 @@ static void BM_MemoryAllocation_SPSCQueue(benchmark::State& state) {
     });
 
     std::thread consumer([&]() {
-        std::unique_ptr<Message> msg;
+        HeapMessage* msg;
         while (!stop_flag.load()) {
             if (queue.pop(msg)) {
+                delete msg;
+                consumed++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    for (auto _ : state) {
+        auto before_mem = getMemoryUsageBytes();
+        auto start = std::chrono::steady_clock::now();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        auto end = std::chrono::steady_clock::now();
+        auto after_mem = getMemoryUsageBytes();
+
+        double elapsed = std::chrono::duration<double>(end - start).count();
+        size_t used_mem = (after_mem > before_mem) ? (after_mem - before_mem) : 0;
+
+        state.counters["Mem_Bytes"] = static_cast<double>(used_mem);
+        state.counters["Produced"] = static_cast<double>(produced.load());
+        state.counters["Consumed"] = static_cast<double>(consumed.load());
+        state.counters["Payload_Size"] = static_cast<double>(payload_size);
+        state.counters["Queue_Capacity"] = static_cast<double>(queue_capacity);
+        state.counters["Alloc_Rate"] = static_cast<double>(produced.load()) / elapsed;
+        state.counters["RSS_Bytes"] = static_cast<double>(after_mem);
+    }
+
+    stop_flag = true;
+    producer.join();
+    consumer.join();
+    for (HeapMessage* msg; queue.pop(msg);) delete msg;
+}
+
+// Same shape as above, but payloads come from a slab of queue_capacity slots
+// allocated up front; the queue only carries handles. Pool
+// exhaustion is back-pressure, so queue_capacity bounds messages in flight.
+static void BM_MemoryAllocation_PooledSPSCQueue(benchmark::State& state) {
+    const size_t payload_size = state.range(0);
+    const size_t queue_capacity = state.range(1);
+
+    SPSCQueue<PayloadHandle> queue{QueueSpec{QUEUE_SLOTS}};
+    PayloadPool pool(queue_capacity, payload_size);
+    std::atomic<bool> stop_flag{false};
+    std::atomic<size_t> produced{0}, consumed{0};
+    std::atomic<uint64_t> checksum{0};
+
+    std::thread producer([&]() {
+        while (!stop_flag.load()) {
+            uint32_t slot = pool.acquire();
+            if (slot == PayloadPool::kNone) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::memset(pool.data(slot), 0xAB, payload_size);
+            while (!queue.push({slot, (uint32_t)payload_size})) {
+                if (stop_flag.load()) return;
+                std::this_thread::yield();
+            }
+            produced++;
+        }
+    });
+
+    std::thread consumer([&]() {
+        PayloadHandle h;
+        uint64_t sum = 0;
+        while (!stop_flag.load()) {
+            if (queue.pop(h)) {
+                sum += pool.data(h.slot)[h.bytes - 1];
+                pool.release(h.slot);
                 consumed++;
             } else {
                 std::this_thread::yield();
             }
         }
+        checksum = sum;
     });
 
     for (auto _ : state) {
@@ -123,11 +173,13 @@ static void BM_MemoryAllocation_SPSCQueue(benchmark::State& state) {
         state.counters["Payload_Size"] = static_cast<double>(payload_size);
         state.counters["Queue_Capacity"] = static_cast<double>(queue_capacity);
         state.counters["Alloc_Rate"] = static_cast<double>(produced.load()) / elapsed;
+        state.counters["RSS_Bytes"] = static_cast<double>(after_mem);
     }
 
     stop_flag = true;
     producer.join();
     consumer.join();
+    benchmark::DoNotOptimize(checksum.load());
 }
 
 // =====================================
@@ -142,4 +194,12 @@ BENCHMARK(BM_MemoryAllocation_SPSCQueue)
     ->Iterations(3)
     ->UseRealTime();
 
+BENCHMARK(BM_MemoryAllocation_PooledSPSCQueue)
+    ->Args({64, 1024})
+    ->Args({1024, 1024})
+    ->Args({8192, 1024})
+    ->Args({1024, 1 << 14})
+    ->Iterations(3)
+    ->UseRealTime();
+
 BENCHMARK_MAIN();
@@ -3,16 +3,36 @@
 #include <atomic>
 #include <vector>
 #include <array>
+#include <span>
+#include <bit>
 #include <cstdint>
 #include <random>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "../include/router/message.hpp"
+#include "../include/router/queues.hpp"
+#include "../include/router/perf_counters.hpp"
+
+// Hardware counters per message moved, over the whole benchmark run
+// including its warm-up; threads must have been joined first.
+static void report_hw_counters(benchmark::State& state, const PerfCounters& perf, uint64_t messages) {
+    perf.per_item(messages, [&](const char* name, double v) {
+        state.counters[std::string(name) + "_per_msg"] = v;
+    });
+}
 
 // ==========================================================
-// Lock-Free SPSC Queue
+// Baseline Lock-Free SPSC Queue (adjacent indices, modulo)
 // ==========================================================
 template <typename T, size_t Capacity>
-class SPSCQueue {
+class BasicSPSCQueue {
 public:
-    SPSCQueue() : head_(0), tail_(0) {}
+    BasicSPSCQueue() : head_(0), tail_(0) {}
 
     bool push(const T& item) {
         auto head = head_.load(std::memory_order_relaxed);
@@ -42,37 +62,53 @@ private:
 // ==========================================================
 // Message
 // ==========================================================
-struct Message {
-    uint64_t timestamp;
-    uint32_t value;
-};
-
+// SPSCQueue, SPSCByteRing and Message are the router's own (include/router).
 constexpr size_t QUEUE_SIZE = 1 << 16;
 
+// The router's queues take their capacity at runtime; the baseline's is a
+// template argument.
+template <typename Queue>
+static std::unique_ptr<Queue> make_queue() {
+    if constexpr (std::is_constructible_v<Queue, QueueSpec>)
+        return std::make_unique<Queue>(QueueSpec{QUEUE_SIZE});
+    else
+        return std::make_unique<Queue>();
+}
+
 // ==========================================================
 // Benchmark: SPSC Queue Throughput
 // ==========================================================
+template <typename Queue>
 static void BM_SPSCQueue_Throughput(benchmark::State& state) {
-    constexpr int batch_size = 1000; // messages per benchmark iteration
-    SPSCQueue<Message, QUEUE_SIZE> queue;
+    auto queue_ptr = make_queue<Queue>();
+    Queue& queue = *queue_ptr;
 
     std::atomic<bool> start_flag{false};
     std::atomic<bool> stop_flag{false};
     std::atomic<uint64_t> count{0};
 
+    std::atomic<uint64_t> moved{0};
+
+    PerfCounters perf(/*inherit=*/true);
+    perf.open();
+    perf.enable();
+
     // Producer thread
     std::thread producer([&]() {
         Message msg{};
+        uint64_t pushed = 0;
         while (!start_flag.load(std::memory_order_acquire)) {
             std::this_thread::yield();
         }
         while (!stop_flag.load(std::memory_order_relaxed)) {
             if (queue.push(msg)) {
                 count.fetch_add(1, std::memory_order_relaxed);
+                ++pushed;
             } else {
                 std::this_thread::yield();
             }
         }
+        moved.store(pushed, std::memory_order_relaxed);
     });
 
     // Consumer thread
@@ -113,6 +149,200 @@ static void BM_SPSCQueue_Throughput(benchmark::State& state) {
         start_flag.store(false);
     }
 
+    stop_flag = true;
+    producer.join();
+    consumer.join();
+    perf.disable();
+    report_hw_counters(state, perf, moved.load(std::memory_order_relaxed));
+}
+
+// ==========================================================
+// Benchmark: SPSC Queue Batched Throughput
+// ==========================================================
+// state.range(0) is the batch size used by both push_bulk and pop_bulk.
+static void BM_SPSCQueue_BatchThroughput(benchmark::State& state) {
+    const size_t batch = static_cast<size_t>(state.range(0));
+    auto queue_ptr = make_queue<SPSCQueue<Message>>();
+    auto& queue = *queue_ptr;
+
+    std::atomic<bool> start_flag{false};
+    std::atomic<bool> stop_flag{false};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> moved{0};
+
+    PerfCounters perf(/*inherit=*/true);
+    perf.open();
+    perf.enable();
+
+    std::thread producer([&]() {
+        std::vector<Message> out(batch);
+        uint64_t pushed = 0;
+        while (!start_flag.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        while (!stop_flag.load(std::memory_order_relaxed)) {
+            size_t n = queue.push_bulk(out.data(), batch);
+            if (n) {
+                count.fetch_add(n, std::memory_order_relaxed);
+                pushed += n;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        moved.store(pushed, std::memory_order_relaxed);
+    });
+
+    std::thread consumer([&]() {
+        std::vector<Message> in(batch);
+        while (!start_flag.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        while (!stop_flag.load(std::memory_order_relaxed)) {
+            if (queue.pop_bulk(in.data(), batch) == 0) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    for (auto _ : state) {
+        count.store(0, std::memory_order_relaxed);
+        start_flag.store(true, std::memory_order_release);
+        auto t_start = std::chrono::steady_clock::now();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        auto t_end = std::chrono::steady_clock::now();
+        stop_flag.store(true, std::memory_order_release);
+
+        double duration_sec = std::chrono::duration<double>(t_end - t_start).count();
+        uint64_t ops = count.load(std::memory_order_relaxed);
+
+        state.SetItemsProcessed(static_cast<int64_t>(ops));
+        state.SetIterationTime(duration_sec);
+        state.counters["Batch"] = static_cast<double>(batch);
+
+        stop_flag.store(false);
+        start_flag.store(false);
+    }
+
+    stop_flag = true;
+    producer.join();
+    consumer.join();
+    perf.disable();
+    report_hw_counters(state, perf, moved.load(std::memory_order_relaxed));
+}
+
+// ==========================================================
+// Benchmark: Variable-Size Payload Throughput
+// ==========================================================
+// Records of state.range(0)..state.range(1) bytes, written in place by the
+// producer and read in place by the consumer. SlotTransport stores each in a
+// max-size SPSCQueue slot, ByteRingTransport packs them into an SPSCByteRing
+// of (just under) the same total size.
+constexpr size_t MAX_RECORD = 2048;
+constexpr size_t RECORD_SLOTS = 1 << 11;
+
+struct SlotTransport {
+    struct Slot {
+        uint32_t bytes;
+        uint8_t data[MAX_RECORD];
+    };
+    SPSCQueue<Slot> queue{QueueSpec{RECORD_SLOTS}};
+
+    uint8_t* reserve(size_t n) {
+        auto span = queue.reserve(1);
+        if (span.empty()) return nullptr;
+        span[0].bytes = (uint32_t)n;
+        return span[0].data;
+    }
+    void commit(size_t) { queue.commit(1); }
+
+    // Calls f(data, bytes) for up to max records, returns how many.
+    template <typename F>
+    size_t consume(size_t max, F&& f) {
+        auto span = queue.peek(max);
+        for (auto& slot : span) f(slot.data, slot.bytes);
+        queue.release(span.size());
+        return span.size();
+    }
+
+    static constexpr size_t footprint() { return sizeof(Slot) * RECORD_SLOTS; }
+};
+
+struct ByteRingTransport {
+    SPSCByteRing<std::bit_floor(sizeof(SlotTransport::Slot) * RECORD_SLOTS)> ring;
+
+    uint8_t* reserve(size_t n) {
+        auto span = ring.reserve(n);
+        return span.empty() ? nullptr : span.data();
+    }
+    void commit(size_t n) { ring.commit(n); }
+
+    template <typename F>
+    size_t consume(size_t max, F&& f) {
+        size_t n = 0;
+        for (std::span<const uint8_t> rec; n < max && !(rec = ring.peek()).empty(); ++n)
+            f(rec.data(), rec.size());
+        if (n) ring.release();
+        return n;
+    }
+
+    static constexpr size_t footprint() { return decltype(ring)::storage_bytes(); }
+};
+
+template <typename Transport>
+static void BM_Payload_Throughput(benchmark::State& state) {
+    const size_t min_bytes = static_cast<size_t>(state.range(0));
+    const size_t max_bytes = static_cast<size_t>(state.range(1));
+    auto transport_ptr = std::make_unique<Transport>();
+    Transport& transport = *transport_ptr;
+
+    std::atomic<bool> stop_flag{false};
+    std::atomic<uint64_t> count{0}, bytes{0};
+
+    std::thread producer([&]() {
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<size_t> size_dist(min_bytes, max_bytes);
+        uint64_t local = 0, local_bytes = 0;
+        while (!stop_flag.load(std::memory_order_relaxed)) {
+            size_t n = size_dist(rng);
+            uint8_t* data;
+            while ((data = transport.reserve(n)) == nullptr) {
+                if (stop_flag.load(std::memory_order_relaxed)) break;
+                std::this_thread::yield();
+            }
+            if (!data) break;
+            std::memset(data, (uint8_t)local, n);
+            transport.commit(n);
+            local_bytes += n;
+            if ((++local & 1023) == 0) {
+                count.store(local, std::memory_order_relaxed);
+                bytes.store(local_bytes, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    std::thread consumer([&]() {
+        uint64_t sum = 0;
+        while (!stop_flag.load(std::memory_order_relaxed)) {
+            if (transport.consume(64, [&](const uint8_t* data, size_t n) { sum += data[0] + data[n - 1]; }) == 0)
+                std::this_thread::yield();
+        }
+        benchmark::DoNotOptimize(sum);
+    });
+
+    for (auto _ : state) {
+        uint64_t c0 = count.load(), b0 = bytes.load();
+        auto t_start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        auto t_end = std::chrono::steady_clock::now();
+
+        state.SetIterationTime(std::chrono::duration<double>(t_end - t_start).count());
+        state.SetItemsProcessed(state.items_processed() + static_cast<int64_t>(count.load() - c0));
+        state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(bytes.load() - b0));
+    }
+    state.counters["Footprint_Bytes"] = static_cast<double>(Transport::footprint());
+
     stop_flag = true;
     producer.join();
     consumer.join();
@@ -121,11 +351,38 @@ static void BM_SPSCQueue_Throughput(benchmark::State& state) {
 // ==========================================================
 // Register benchmark
 // ==========================================================
-BENCHMARK(BM_SPSCQueue_Throughput)
+BENCHMARK_TEMPLATE(BM_SPSCQueue_Throughput, BasicSPSCQueue<Message, QUEUE_SIZE>)
     ->Unit(benchmark::kMillisecond)
     ->UseRealTime()
     ->Iterations(5); // run few times for stability
 
+BENCHMARK_TEMPLATE(BM_SPSCQueue_Throughput, SPSCQueue<Message>)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Iterations(5);
+
+BENCHMARK(BM_SPSCQueue_BatchThroughput)
+    ->RangeMultiplier(2)
+    ->Range(1, 256)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Iterations(5);
+
+// Market-data sized records: 40B to 2KB, and small-only for contrast.
+BENCHMARK_TEMPLATE(BM_Payload_Throughput, SlotTransport)
+    ->Args({40, 2048})
+    ->Args({40, 256})
+    ->Unit(benchmark::kMillisecond)
+    ->UseManualTime()
+    ->Iterations(3);
+
+BENCHMARK_TEMPLATE(BM_Payload_Throughput, ByteRingTransport)
+    ->Args({40, 2048})
+    ->Args({40, 256})
+    ->Unit(benchmark::kMillisecond)
+    ->UseManualTime()
+    ->Iterations(3);
+
 // ==========================================================
 // Main
 // ==========================================================
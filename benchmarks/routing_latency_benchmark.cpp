@@ -1,111 +1,246 @@
 #include <benchmark/benchmark.h>
-#include <queue>
-#include <mutex>
 #include <thread>
-#include <condition_variable>
 #include <vector>
 #include <atomic>
 #include <random>
-
-// Simulated message
-struct Message {
-    int id;
-    std::string payload;
-};
-
-// === Simulated router with routing overhead ===
-class Router {
-public:
-    void routeMessage(const Message& msg) {
-        // Simulate small routing overhead
-        std::unique_lock<std::mutex> lock(mutex_);
-        routed_messages_.push(msg);
-        lock.unlock();
-        cv_.notify_one();
+#include <array>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+#include "../include/router/message.hpp"
+#include "../include/router/routing.hpp"
+
+// Generated from configs/baseline.json by router --emit-topology.
+#include "baseline_topology.hpp"
+
+// === Routing tables: loaded config vs compile-time topology ===
+// The router's per-message routing: stage-1 processor and stage-2 strategy
+// lookup, then Stage2Outbox::route(). The dynamic side is DynamicRouting over
+// a RoutingConfig holding the generated topology, the static side
+// StaticRouting<GeneratedTopology>.
+constexpr size_t kRouteBatch = MAX_BATCH;
+
+static RoutingConfig routing_config(int producers, int processors, int strategies, IngressTopology ingress,
+                                    const std::array<int, MAX_MSG_TYPES>& stage1,
+                                    const std::array<int, MAX_MSG_TYPES>& stage2) {
+    RoutingConfig cfg{producers, processors, strategies, ingress, {}, {}, {}};
+    for (int type = 0; type < MAX_MSG_TYPES; ++type) {
+        cfg.stage1_routing.push_back(Stage1Route{{stage1[type]}});
+        cfg.stage2_routing.push_back(stage2[type]);
+        cfg.ordering_required.push_back(false);
     }
+    return cfg;
+}
 
-    Message getNextMessage() {
-        std::unique_lock<std::mutex> lock(mutex_);
-        cv_.wait(lock, [&]{ return !routed_messages_.empty(); });
-        Message msg = routed_messages_.front();
-        routed_messages_.pop();
-        return msg;
-    }
+static RoutingConfig generated_routing_config() {
+    using T = GeneratedTopology;
+    RoutingConfig cfg = routing_config(T::producer_count, T::processor_count, T::strategy_count, T::ingress,
+                                       T::fixed_processor, T::stage2);
+    for (int type = 0; type < MAX_MSG_TYPES; ++type) cfg.ordering_required[type] = T::ordered[type];
+    return cfg;
+}
 
-private:
-    std::mutex mutex_;
-    std::condition_variable cv_;
-    std::queue<Message> routed_messages_;
-};
-
-// === Direct queue (no routing logic) ===
-class DirectQueue {
-public:
-    void push(const Message& msg) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        queue_.push(msg);
-        lock.unlock();
-        cv_.notify_one();
-    }
+template <typename Routes>
+static void route_batches(benchmark::State& state, const Routes& routes) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> type_dist(0, 3);
+    std::vector<uint8_t> types(1 << 12);
+    for (auto& t : types) t = (uint8_t)type_dist(gen);
 
-    Message pop() {
-        std::unique_lock<std::mutex> lock(mutex_);
-        cv_.wait(lock, [&]{ return !queue_.empty(); });
-        Message msg = queue_.front();
-        queue_.pop();
-        return msg;
+    Stage2Outbox outbox(routes.strategy_count());
+    Message msg{};
+    size_t offset = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < kRouteBatch; ++i) {
+            msg.msg_type = types[(offset + i) & (types.size() - 1)];
+            msg.processor_id = (uint8_t)routes.fixed_processor(msg.msg_type);
+            outbox.route(routes, msg);
+        }
+        for (int sid = 0; sid < routes.strategy_count(); ++sid)
+            benchmark::DoNotOptimize(outbox.take(sid).data());
+        offset += kRouteBatch;
     }
+    state.SetItemsProcessed(state.iterations() * kRouteBatch);
+}
 
-private:
-    std::mutex mutex_;
-    std::condition_variable cv_;
-    std::queue<Message> queue_;
-};
+static void BM_RoutingTable_Dynamic(benchmark::State& state) {
+    const RoutingConfig cfg = generated_routing_config();
+    const RoutingTables tables(cfg);
+    route_batches(state, DynamicRouting(cfg, tables));
+}
 
-// === Benchmark Setup ===
+static void BM_RoutingTable_Static(benchmark::State& state) {
+    route_batches(state, StaticRouting<GeneratedTopology>{});
+}
 
-static void BM_RoutingLogicOverhead(benchmark::State& state) {
-    Router router;
-    std::atomic<bool> running{true};
-    Message msg{42, "payload"};
+// === Stage-1 -> stage-2 hop through the router's queues ===
+// range(0) is the IngressTopology. Processors pop a batch from their
+// Stage1Ingress queue, route it through a Stage2Outbox and bulk-push each box
+// into the strategy's SPSCLaneSet, as the router does minus processing cost.
+constexpr size_t kHopCapacity = 1 << 14;
+
+static void drain_outbox(Stage2Outbox& outbox, std::vector<std::unique_ptr<SPSCLaneSet>>& stage2, int proc_id,
+                         const std::atomic<bool>& stop) {
+    for (int sid = 0; sid < (int)stage2.size(); ++sid) {
+        std::span<Message> box = outbox.take(sid);
+        auto& lane = stage2[sid]->lane(proc_id);
+        for (size_t sent = 0; sent < box.size() && !stop.load(std::memory_order_relaxed);) {
+            sent += lane.push_bulk(box.data() + sent, box.size() - sent);
+            if (sent < box.size()) std::this_thread::yield();
+        }
+    }
+}
 
-    std::thread worker([&] {
-        while (running) {
-            router.getNextMessage();
+// One message in flight: the benchmark thread pushes into stage 1 and waits
+// for it to come back out of stage 2; each iteration is one round trip.
+static void BM_Hop_PingPong(benchmark::State& state) {
+    const auto topology = static_cast<IngressTopology>(state.range(0));
+    Stage1Ingress stage1(topology, 1, 1, QueueSpec{kHopCapacity});
+    std::vector<std::unique_ptr<SPSCLaneSet>> stage2;
+    stage2.push_back(std::make_unique<SPSCLaneSet>(1, QueueSpec{kHopCapacity}));
+    const RoutingConfig cfg = routing_config(1, 1, 1, topology, {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0});
+    const RoutingTables tables(cfg);
+    const DynamicRouting routes(cfg, tables);
+    std::atomic<bool> stop{false};
+
+    std::thread processor([&] {
+        Stage2Outbox outbox(1);
+        std::array<Message, MAX_BATCH> batch;
+        while (!stop.load(std::memory_order_relaxed)) {
+            size_t n = stage1.pop_bulk(topology, 0, batch.data(), batch.size(), [](const uint8_t*, size_t) {});
+            if (n == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < n; ++i) outbox.route(routes, batch[i]);
+            drain_outbox(outbox, stage2, 0, stop);
         }
     });
 
+    std::vector<uint64_t> rtt_ns;
+    rtt_ns.reserve(1 << 20);
+    Message msg{}, back;
     for (auto _ : state) {
-        router.routeMessage(msg);
+        auto t0 = std::chrono::steady_clock::now();
+        while (!stage1.push(topology, 0, 0, msg)) std::this_thread::yield();
+        while (stage2[0]->pop_bulk(&back, 1) == 0) std::this_thread::yield();
+        auto t1 = std::chrono::steady_clock::now();
+        if (rtt_ns.size() < rtt_ns.capacity())
+            rtt_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        ++msg.sequence;
     }
-
-    running = false;
-    router.routeMessage(msg); // unblock thread
-    worker.join();
+    stop = true;
+    processor.join();
+
+    std::sort(rtt_ns.begin(), rtt_ns.end());
+    auto pct = [&](double p) { return rtt_ns.empty() ? 0.0 : (double)rtt_ns[(size_t)(p * (rtt_ns.size() - 1))]; };
+    state.counters["RTT_p50_ns"] = pct(0.50);
+    state.counters["RTT_p99_ns"] = pct(0.99);
+    state.counters["RTT_p999_ns"] = pct(0.999);
+    state.SetLabel(ingress_topology_name(topology));
 }
 
-static void BM_DirectQueueAccess(benchmark::State& state) {
-    DirectQueue queue;
-    std::atomic<bool> running{true};
-    Message msg{42, "payload"};
-
-    std::thread worker([&] {
-        while (running) {
-            queue.pop();
-        }
-    });
-
+// Saturated pipeline: range(1) producers, two processors, two strategies,
+// message types spread over both processors and both strategies. Items are
+// messages delivered to the strategies.
+static void BM_Topology_Throughput(benchmark::State& state) {
+    const auto topology = static_cast<IngressTopology>(state.range(0));
+    const int producers = static_cast<int>(state.range(1));
+    constexpr int kProcessors = 2, kStrategies = 2;
+    Stage1Ingress stage1(topology, producers, kProcessors, QueueSpec{kHopCapacity});
+    std::vector<std::unique_ptr<SPSCLaneSet>> stage2;
+    for (int i = 0; i < kStrategies; ++i)
+        stage2.push_back(std::make_unique<SPSCLaneSet>(kProcessors, QueueSpec{kHopCapacity}));
+    const RoutingConfig cfg = routing_config(producers, kProcessors, kStrategies, topology,
+                                             {0, 1, 0, 1, 0, 1, 0, 1}, {0, 0, 1, 1, 0, 0, 1, 1});
+    const RoutingTables tables(cfg);
+    const DynamicRouting routes(cfg, tables);
+    std::atomic<bool> stop{false};
+    struct alignas(64) Delivered {
+        std::atomic<uint64_t> count{0};
+    };
+    std::array<Delivered, kStrategies> delivered;
+
+    std::vector<std::thread> threads;
+    for (int pid = 0; pid < producers; ++pid)
+        threads.emplace_back([&, pid] {
+            Message msg{};
+            msg.producer_id = (uint8_t)pid;
+            for (uint32_t i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+                msg.msg_type = (uint8_t)(i & 3);
+                msg.sequence = i;
+                while (!stage1.push(topology, pid, routes.fixed_processor(msg.msg_type), msg)) {
+                    if (stop.load(std::memory_order_relaxed)) return;
+                    std::this_thread::yield();
+                }
+            }
+        });
+    for (int proc_id = 0; proc_id < kProcessors; ++proc_id)
+        threads.emplace_back([&, proc_id] {
+            Stage2Outbox outbox(kStrategies);
+            std::array<Message, MAX_BATCH> batch;
+            while (!stop.load(std::memory_order_relaxed)) {
+                size_t n = stage1.pop_bulk(topology, proc_id, batch.data(), batch.size(),
+                                           [](const uint8_t*, size_t) {});
+                if (n == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < n; ++i) outbox.route(routes, batch[i]);
+                drain_outbox(outbox, stage2, proc_id, stop);
+            }
+        });
+    for (int sid = 0; sid < kStrategies; ++sid)
+        threads.emplace_back([&, sid] {
+            std::array<Message, MAX_BATCH> batch;
+            uint64_t local = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                size_t n = stage2[sid]->pop_bulk(batch.data(), batch.size());
+                if (n == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                local += n;
+                delivered[sid].count.store(local, std::memory_order_relaxed);
+            }
+        });
+
+    auto total = [&] {
+        uint64_t sum = 0;
+        for (auto& d : delivered) sum += d.count.load(std::memory_order_relaxed);
+        return sum;
+    };
     for (auto _ : state) {
-        queue.push(msg);
+        uint64_t c0 = total();
+        auto t_start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        auto t_end = std::chrono::steady_clock::now();
+        state.SetIterationTime(std::chrono::duration<double>(t_end - t_start).count());
+        state.SetItemsProcessed(state.items_processed() + static_cast<int64_t>(total() - c0));
     }
+    stop = true;
+    for (auto& t : threads) t.join();
+    state.SetLabel(ingress_topology_name(topology));
+}
 
-    running = false;
-    queue.push(msg); // unblock thread
-    worker.join();
+static void topology_args(benchmark::internal::Benchmark* b) {
+    for (auto t : {IngressTopology::Shared, IngressTopology::Lanes, IngressTopology::Mpsc, IngressTopology::ByteLanes})
+        for (int producers : {1, 2, 4})
+            if (t != IngressTopology::Shared || producers == 1) b->Args({(int)t, producers});
 }
 
 // === Register Benchmarks ===
-BENCHMARK(BM_RoutingLogicOverhead);
-BENCHMARK(BM_DirectQueueAccess);
+BENCHMARK(BM_RoutingTable_Dynamic);
+BENCHMARK(BM_RoutingTable_Static);
+BENCHMARK(BM_Hop_PingPong)
+    ->DenseRange((int)IngressTopology::Shared, (int)IngressTopology::ByteLanes)
+    ->Iterations(20000);
+BENCHMARK(BM_Topology_Throughput)
+    ->Apply(topology_args)
+    ->Unit(benchmark::kMillisecond)
+    ->UseManualTime()
+    ->Iterations(3);
 
 BENCHMARK_MAIN();
@@ -2,20 +2,37 @@
 #include <thread>
 #include <vector>
 #include <queue>
+#include <array>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
-#include <random>
+#include <memory>
 #include <chrono>
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "../include/router/latency_histogram.hpp"
+#include "../include/router/message.hpp"
+#include "../include/router/perf_counters.hpp"
+#include "../include/router/queues.hpp"
+#include "../include/router/routing.hpp"
+
+constexpr size_t kCapacity = 1 << 14;          // slots per queue (in total for the sharded matrix)
+constexpr uint64_t kTotalMessages = 1 << 20;   // per run, split across producers
+
+static inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 // ============================================================
-// Simple thread-safe queue for multi-producer / multi-consumer
+// Mutex baseline
 // ============================================================
 template <typename T>
-class MPMCQueue {
+class MutexMPMCQueue {
 public:
-    explicit MPMCQueue(size_t capacity) : capacity_(capacity) {}
+    explicit MutexMPMCQueue(size_t capacity) : capacity_(capacity) {}
 
     bool push(const T& item) {
         std::unique_lock<std::mutex> lock(mutex_);
@@ -41,98 +58,396 @@ private:
 };
 
 // ============================================================
-// Workload simulation
+// LCRQ
 // ============================================================
-struct Message {
-    uint64_t id;
-    std::array<uint8_t, 128> payload; // moderate message size
+// Morrison & Afek's LCRQ: a linked list of CRQ rings. Producers and consumers
+// claim cells with fetch-and-add on the ring's tail/head instead of retrying
+// a CAS on a shared index, then settle the cell with a 16-byte CAS on
+// (unsafe|index, state). A producer that finds its ring full (or keeps
+// losing its cells) closes it and links a new ring. The Message sits beside
+// its cell: the winning producer marks the cell busy, writes, then full.
+// Rings are freed through per-thread hazard pointers, and at most
+// capacity / kRing rings are live, so the queue is bounded like the others.
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+class LCRQueue {
+    static constexpr uint64_t kRing = 1 << 12;
+    static constexpr uint64_t kMask = kRing - 1;
+    static constexpr uint64_t kEmpty = 0, kBusy = 1, kFull = 2;
+    static constexpr uint64_t kTopBit = uint64_t(1) << 63; // unsafe (cell index), closed (tail)
+    static constexpr int kStarving = 64;
+
+    struct alignas(16) Cell {
+        uint64_t idx;
+        uint64_t state;
+    };
+
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        alignas(64) std::atomic<Ring*> next{nullptr};
+        std::unique_ptr<Cell[]> cells{new Cell[kRing]};
+        std::unique_ptr<Message[]> data{new Message[kRing]};
+
+        Ring() {
+            for (uint64_t i = 0; i < kRing; ++i) cells[i] = {i, kEmpty};
+        }
+    };
+
+    struct alignas(64) Hazard {
+        std::atomic<Ring*> ring{nullptr};
+    };
+
+public:
+    // threads: how many distinct thread indices push()/pop() will see.
+    LCRQueue(size_t capacity, int threads)
+        : max_rings_(std::max<uint64_t>(2, capacity / kRing)), hazards_(threads) {
+        Ring* first = new Ring;
+        head_.store(first);
+        tail_.store(first);
+    }
+
+    ~LCRQueue() {
+        for (Ring* r = head_.load(); r;) {
+            Ring* next = r->next.load();
+            delete r;
+            r = next;
+        }
+        for (Ring* r : retired_) delete r;
+    }
+
+    bool push(int thread, const Message& msg) {
+        for (;;) {
+            Ring* r = protect(thread, tail_);
+            if (Ring* next = r->next.load()) {
+                tail_.compare_exchange_strong(r, next);
+                continue;
+            }
+            if (ring_push(*r, msg)) break;
+            if (live_rings_.load(std::memory_order_relaxed) >= max_rings_) {
+                hazards_[thread].ring.store(nullptr, std::memory_order_release);
+                return false;
+            }
+            Ring* fresh = new Ring;
+            ring_push(*fresh, msg);
+            Ring* expected = nullptr;
+            if (r->next.compare_exchange_strong(expected, fresh)) {
+                live_rings_.fetch_add(1, std::memory_order_relaxed);
+                tail_.compare_exchange_strong(r, fresh);
+                break;
+            }
+            delete fresh;
+        }
+        hazards_[thread].ring.store(nullptr, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(int thread, Message& out) {
+        for (;;) {
+            Ring* r = protect(thread, head_);
+            if (ring_pop(*r, out)) break;
+            Ring* next = r->next.load();
+            if (!next) {
+                hazards_[thread].ring.store(nullptr, std::memory_order_release);
+                return false;
+            }
+            if (ring_pop(*r, out)) break;
+            // Move tail off r first, so no producer can pick r up once it
+            // is retired.
+            Ring* expected = r;
+            tail_.compare_exchange_strong(expected, next);
+            if (head_.compare_exchange_strong(r, next)) {
+                hazards_[thread].ring.store(nullptr, std::memory_order_release);
+                live_rings_.fetch_sub(1, std::memory_order_relaxed);
+                retire(r);
+            }
+        }
+        hazards_[thread].ring.store(nullptr, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static uint64_t load(uint64_t& word) { return std::atomic_ref<uint64_t>(word).load(std::memory_order_acquire); }
+
+    static bool cas2(Cell& cell, uint64_t idx, uint64_t state, uint64_t new_idx, uint64_t new_state) {
+        using u128 = unsigned __int128;
+        u128 expected = ((u128)state << 64) | idx;
+        u128 desired = ((u128)new_state << 64) | new_idx;
+        return __sync_bool_compare_and_swap(reinterpret_cast<u128*>(&cell), expected, desired);
+    }
+
+    static bool ring_push(Ring& r, const Message& msg) {
+        for (int tries = 0;; ++tries) {
+            const uint64_t t = r.tail.fetch_add(1);
+            if (t & kTopBit) return false; // closed
+            Cell& cell = r.cells[t & kMask];
+            const uint64_t idx = load(cell.idx), state = load(cell.state);
+            if (state == kEmpty && (idx & ~kTopBit) <= t &&
+                (!(idx & kTopBit) || r.head.load() <= t) && cas2(cell, idx, kEmpty, t, kBusy)) {
+                r.data[t & kMask] = msg;
+                std::atomic_ref<uint64_t>(cell.state).store(kFull, std::memory_order_release);
+                return true;
+            }
+            const uint64_t h = r.head.load();
+            if ((int64_t)(t - h) >= (int64_t)kRing || tries >= kStarving) {
+                r.tail.fetch_or(kTopBit);
+                return false;
+            }
+        }
+    }
+
+    static bool ring_pop(Ring& r, Message& out) {
+        for (;;) {
+            const uint64_t h = r.head.fetch_add(1);
+            Cell& cell = r.cells[h & kMask];
+            for (;;) {
+                const uint64_t idx = load(cell.idx), state = load(cell.state);
+                const uint64_t unsafe = idx & kTopBit, i = idx & ~kTopBit;
+                if (i > h) break;
+                if (state == kEmpty) {
+                    // Nobody has written h yet; move the cell on so that
+                    // producer retries elsewhere.
+                    if (cas2(cell, idx, kEmpty, unsafe | (h + kRing), kEmpty)) break;
+                } else if (i == h) {
+                    if (state == kBusy) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    out = r.data[h & kMask];
+                    if (cas2(cell, idx, kFull, unsafe | (h + kRing), kEmpty)) return true;
+                } else if (cas2(cell, idx, state, idx | kTopBit, state)) {
+                    break; // an older lap's value is still here: mark unsafe
+                }
+            }
+            const uint64_t t = r.tail.load() & ~kTopBit;
+            if (t <= h + 1) {
+                fix_state(r);
+                return false;
+            }
+        }
+    }
+
+    // Pulls tail up to head after consumers overtook it on an empty ring.
+    static void fix_state(Ring& r) {
+        for (;;) {
+            uint64_t t = r.tail.load();
+            const uint64_t h = r.head.load();
+            if (r.tail.load() != t) continue;
+            if (h <= (t & ~kTopBit)) return;
+            if (r.tail.compare_exchange_strong(t, (t & kTopBit) | h)) return;
+        }
+    }
+
+    Ring* protect(int thread, std::atomic<Ring*>& src) {
+        Ring* r = src.load();
+        for (;;) {
+            hazards_[thread].ring.store(r);
+            Ring* again = src.load();
+            if (again == r) return r;
+            r = again;
+        }
+    }
+
+    void retire(Ring* r) {
+        std::lock_guard<std::mutex> lock(retire_mutex_);
+        retired_.push_back(r);
+        if (retired_.size() < 8) return;
+        std::vector<Ring*> kept;
+        for (Ring* old : retired_) {
+            bool hazardous = false;
+            for (auto& h : hazards_) hazardous |= h.ring.load() == old;
+            if (hazardous) kept.push_back(old);
+            else delete old;
+        }
+        retired_.swap(kept);
+    }
+
+    const uint64_t max_rings_;
+    alignas(64) std::atomic<Ring*> head_;
+    alignas(64) std::atomic<Ring*> tail_;
+    alignas(64) std::atomic<uint64_t> live_rings_{1};
+    std::vector<Hazard> hazards_;
+    std::mutex retire_mutex_;
+    std::vector<Ring*> retired_;
 };
+#endif
 
 // ============================================================
-// Scaling benchmark
+// Queues under test
 // ============================================================
-static void BM_Scaling_MPMCQueue(benchmark::State& state) {
-    int num_producers = static_cast<int>(state.range(0));
-    int num_consumers = static_cast<int>(state.range(1));
-    const size_t capacity = 1 << 14;
-    const int ops_per_thread = 200000;
-
-    MPMCQueue<Message> queue(capacity);
-    std::atomic<bool> stop_flag{false};
-    std::atomic<uint64_t> produced{0}, consumed{0};
-
-    auto producer_fn = [&](int id) {
-        std::mt19937_64 gen(id);
-        for (int i = 0; i < ops_per_thread && !stop_flag.load(); ++i) {
-            Message msg{static_cast<uint64_t>(i)};
-            while (!queue.push(msg)) {
-                std::this_thread::yield();
-            }
-            produced++;
-        }
+// Every candidate takes (producers, consumers) and is driven through
+// push(producer, msg) / pop(consumer, msg).
+struct MutexQueue {
+    MutexMPMCQueue<Message> queue{kCapacity};
+
+    MutexQueue(int, int) {}
+    bool push(int, const Message& msg) { return queue.push(msg); }
+    bool pop(int, Message& msg) { return queue.pop(msg); }
+};
+
+// The router's Vyukov ring (stage1_ingress: mpsc).
+struct VyukovQueue {
+    MPMCQueue<Message> queue{QueueSpec{kCapacity}};
+
+    VyukovQueue(int, int) {}
+    bool push(int, const Message& msg) { return queue.push(msg); }
+    bool pop(int, Message& msg) { return queue.pop(msg); }
+};
+
+// A producer x consumer matrix of the router's SPSC lanes: producer p
+// writes lane p of each consumer's SPSCLaneSet in turn, skipping full ones.
+struct ShardedSPSCQueue {
+    struct alignas(64) Cursor {
+        int next = 0;
     };
+    std::vector<std::unique_ptr<SPSCLaneSet>> consumers;
+    std::vector<Cursor> cursors;
 
-    auto consumer_fn = [&]() {
-        Message msg;
-        while (!stop_flag.load() || consumed < produced) {
-            if (queue.pop(msg)) {
-                consumed++;
-            } else {
-                std::this_thread::yield();
+    ShardedSPSCQueue(int producer_count, int consumer_count) : cursors(producer_count) {
+        const size_t lane = std::max<size_t>(64, std::bit_floor(kCapacity / (producer_count * consumer_count)));
+        for (int c = 0; c < consumer_count; ++c)
+            consumers.push_back(std::make_unique<SPSCLaneSet>(producer_count, QueueSpec{lane}));
+        for (int p = 0; p < producer_count; ++p) cursors[p].next = p % consumer_count;
+    }
+
+    bool push(int producer, const Message& msg) {
+        const int count = (int)consumers.size();
+        int& next = cursors[producer].next;
+        for (int i = 0; i < count; ++i) {
+            const int c = (next + i) % count;
+            if (consumers[c]->lane(producer).push(msg)) {
+                next = c + 1;
+                return true;
             }
         }
-    };
+        return false;
+    }
 
-    for (auto _ : state) {
-        produced = 0;
-        consumed = 0;
-        stop_flag = false;
+    bool pop(int consumer, Message& msg) { return consumers[consumer]->pop_bulk(&msg, 1) == 1; }
+};
 
-        auto start_time = std::chrono::steady_clock::now();
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+struct LCRQ {
+    int producers;
+    LCRQueue queue;
 
-        std::vector<std::thread> producers;
-        std::vector<std::thread> consumers;
+    LCRQ(int producer_count, int consumer_count)
+        : producers(producer_count), queue(kCapacity, producer_count + consumer_count) {}
+    bool push(int producer, const Message& msg) { return queue.push(producer, msg); }
+    bool pop(int consumer, Message& msg) { return queue.pop(producers + consumer, msg); }
+};
+#endif
 
-        for (int i = 0; i < num_producers; ++i)
-            producers.emplace_back(producer_fn, i);
+// ============================================================
+// Scaling benchmark
+// ============================================================
+// range(0) producers and range(1) consumers move kTotalMessages as fast as
+// the queue allows. Each message carries its send time; consumers record
+// send-to-receive latency per message, so the percentiles include time spent
+// queued behind a full queue.
+template <typename Queue>
+static void BM_Scaling(benchmark::State& state) {
+    const int num_producers = static_cast<int>(state.range(0));
+    const int num_consumers = static_cast<int>(state.range(1));
+    const uint64_t per_producer = kTotalMessages / num_producers;
+    LatencyHistogram latency;
+    uint64_t consumed_total = 0;
 
-        for (int i = 0; i < num_consumers; ++i)
-            consumers.emplace_back(consumer_fn);
+    // Inherited by each iteration's threads; HITM per message is the queue's
+    // cross-core cache-line traffic.
+    PerfCounters perf(/*inherit=*/true);
+    perf.open();
+    perf.enable();
 
-        for (auto& p : producers) p.join();
+    for (auto _ : state) {
+        auto queue = std::make_unique<Queue>(num_producers, num_consumers);
+        std::atomic<bool> go{false};
+        std::atomic<int> producers_left{num_producers};
+        std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+        std::vector<uint64_t> consumed(num_consumers, 0);
+        for (int i = 0; i < num_consumers; ++i) histograms.push_back(std::make_unique<LatencyHistogram>());
 
-        // Let consumers drain remaining messages
-        std::this_thread::sleep_for(std::chrono::milliseconds(200));
-        stop_flag = true;
-        for (auto& c : consumers) c.join();
+        std::vector<std::thread> threads;
+        for (int p = 0; p < num_producers; ++p)
+            threads.emplace_back([&, p] {
+                while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+                Message msg{};
+                msg.producer_id = (uint8_t)p;
+                for (uint64_t i = 0; i < per_producer; ++i) {
+                    msg.sequence = (uint32_t)i;
+                    msg.timestamp_ns = now_ns();
+                    while (!queue->push(p, msg)) std::this_thread::yield();
+                }
+                producers_left.fetch_sub(1, std::memory_order_release);
+            });
+        for (int c = 0; c < num_consumers; ++c)
+            threads.emplace_back([&, c] {
+                while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+                LatencyHistogram& hist = *histograms[c];
+                Message msg;
+                uint64_t n = 0;
+                for (;;) {
+                    if (queue->pop(c, msg)) {
+                        hist.record(now_ns() - msg.timestamp_ns);
+                        ++n;
+                    } else if (producers_left.load(std::memory_order_acquire) == 0) {
+                        // Every push has completed, so one more miss means empty.
+                        if (!queue->pop(c, msg)) break;
+                        hist.record(now_ns() - msg.timestamp_ns);
+                        ++n;
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+                consumed[c] = n;
+            });
 
+        auto start_time = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        for (auto& t : threads) t.join();
         auto end_time = std::chrono::steady_clock::now();
-        double elapsed = std::chrono::duration<double>(end_time - start_time).count();
+        state.SetIterationTime(std::chrono::duration<double>(end_time - start_time).count());
 
-        double throughput = static_cast<double>(consumed.load()) / elapsed;
-
-        state.counters["Producers"] = num_producers;
-        state.counters["Consumers"] = num_consumers;
-        state.counters["Produced"] = static_cast<double>(produced.load());
-        state.counters["Consumed"] = static_cast<double>(consumed.load());
-        state.counters["Throughput_msgs_per_s"] = throughput;
-        state.counters["Latency_us_per_msg"] = (elapsed * 1e6) / consumed.load();
+        uint64_t run_consumed = 0;
+        for (int c = 0; c < num_consumers; ++c) {
+            run_consumed += consumed[c];
+            latency.merge(*histograms[c]);
+        }
+        if (run_consumed != per_producer * num_producers) {
+            state.SkipWithError("messages lost or duplicated");
+            break;
+        }
+        consumed_total += run_consumed;
     }
+    perf.disable();
 
-    stop_flag = true;
+    state.SetItemsProcessed(static_cast<int64_t>(consumed_total));
+    state.counters["Producers"] = num_producers;
+    state.counters["Consumers"] = num_consumers;
+    state.counters["Latency_p50_ns"] = static_cast<double>(latency.percentile(0.50));
+    state.counters["Latency_p99_ns"] = static_cast<double>(latency.percentile(0.99));
+    state.counters["Latency_p999_ns"] = static_cast<double>(latency.percentile(0.999));
+    state.counters["Latency_max_ns"] = static_cast<double>(latency.max());
+    perf.per_item(consumed_total, [&](const char* name, double v) {
+        state.counters[std::string(name) + "_per_msg"] = v;
+    });
 }
 
 // ============================================================
 // Benchmark registrations
 // ============================================================
 
-// Arguments: (num_producers, num_consumers)
-BENCHMARK(BM_Scaling_MPMCQueue)
-    ->Args({1, 1})
-    ->Args({2, 2})
-    ->Args({4, 4})
-    ->Args({8, 8})
-    ->Iterations(3)
-    ->UseRealTime();
+// Arguments: (num_producers, num_consumers). Pairs from 1 to 32, plus the
+// many-producers-to-one-processor shape of stage 1.
+static void scaling_args(benchmark::internal::Benchmark* b) {
+    for (int n : {1, 2, 4, 8, 16, 32}) b->Args({n, n});
+    for (int n : {4, 16}) b->Args({n, 1});
+}
+
+BENCHMARK_TEMPLATE(BM_Scaling, MutexQueue)->Apply(scaling_args)->Iterations(3)->UseManualTime();
+BENCHMARK_TEMPLATE(BM_Scaling, VyukovQueue)->Apply(scaling_args)->Iterations(3)->UseManualTime();
+BENCHMARK_TEMPLATE(BM_Scaling, ShardedSPSCQueue)->Apply(scaling_args)->Iterations(3)->UseManualTime();
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+BENCHMARK_TEMPLATE(BM_Scaling, LCRQ)->Apply(scaling_args)->Iterations(3)->UseManualTime();
+#endif
 
 BENCHMARK_MAIN();
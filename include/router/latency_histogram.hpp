@@ -0,0 +1,111 @@
+// Fixed-memory latency histogram used for every percentile the router and
+// the benchmarks report.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// ==========================================================
+// Latency Histogram
+// ==========================================================
+// Log-linear (HDR style) histogram of integer nanoseconds with fixed memory.
+// Values below 2^kSubBits are exact; every power-of-two range above that is
+// split into kSubCount/2 buckets. A reported value is the top of its bucket,
+// at most 2/kSubCount (1/64, ~1.6%) above the sample.
+// Single writer; per-thread copies are combined with merge().
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 7;
+    static constexpr uint64_t kSubCount = uint64_t(1) << kSubBits;
+    static constexpr uint64_t kHalfCount = kSubCount / 2;
+    static constexpr int kMaxBits = 40; // values are clamped to ~18 minutes
+    static constexpr uint64_t kMaxValue = (uint64_t(1) << kMaxBits) - 1;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 2) * kHalfCount;
+
+    void record(uint64_t ns) {
+        ns = std::min(ns, kMaxValue);
+        ++counts_[bucket_index(ns)];
+        ++total_;
+        max_ = std::max(max_, ns);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < kBuckets; ++i)
+            counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() {
+        counts_.fill(0);
+        total_ = 0;
+        max_ = 0;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+
+    // Merges raw plus, HdrHistogram style, the samples a sender stalled for
+    // v would have recorded had it kept its schedule: each value v also
+    // stands for v - interval, v - 2*interval, ... down to interval. Counts
+    // are spread per bucket, so a correction costs O(kBuckets^2), not O(v).
+    void merge_corrected(const LatencyHistogram& raw, uint64_t interval) {
+        merge(raw);
+        if (interval == 0) return;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            uint64_t c = raw.counts_[i];
+            uint64_t v = std::min(bucket_high(i), raw.max_);
+            if (c == 0 || v < 2 * interval) continue;
+            const uint64_t k_max = v / interval - 1; // v - k*interval >= interval
+            for (size_t b = bucket_index(interval); b <= bucket_index(v - interval); ++b) {
+                uint64_t lo = bucket_low(b), hi = bucket_high(b);
+                uint64_t k_first = hi >= v ? 1 : std::max<uint64_t>(1, (v - hi + interval - 1) / interval);
+                uint64_t k_last = std::min(k_max, (v - lo) / interval);
+                if (k_first > k_last) continue;
+                counts_[b] += c * (k_last - k_first + 1);
+                total_ += c * (k_last - k_first + 1);
+            }
+        }
+    }
+
+    // Highest value equivalent to the bucket holding the p-th sample.
+    uint64_t percentile(double p) const {
+        if (total_ == 0) return 0;
+        uint64_t target = std::max<uint64_t>(1, (uint64_t)std::ceil(p * total_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= target)
+                return std::min(bucket_high(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static size_t bucket_index(uint64_t v) {
+        if (v < kSubCount) return v;
+        int shift = std::bit_width(v) - kSubBits;
+        return shift * kHalfCount + (v >> shift);
+    }
+
+    static uint64_t bucket_low(size_t i) {
+        if (i < kSubCount) return i;
+        int shift = (int)(i / kHalfCount) - 1;
+        return (i - shift * kHalfCount) << shift;
+    }
+
+    static uint64_t bucket_high(size_t i) {
+        if (i < kSubCount) return i;
+        int shift = (int)(i / kHalfCount) - 1;
+        uint64_t sub = i - shift * kHalfCount;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, kBuckets> counts_{};
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+};
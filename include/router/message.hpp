@@ -0,0 +1,50 @@
+// The fixed-size message that travels through every router queue.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+constexpr int MAX_BATCH = 256;
+constexpr int MAX_MSG_TYPES = 8;
+
+// ==========================================================
+// Message Structure
+// ==========================================================
+enum MessageFlags : uint8_t {
+    MSG_STOLEN = 1 << 0, // processed by a work-stealing peer
+};
+
+// Packed so two messages share a cache line: the one-byte fields sit
+// together and the processor timings are 32-bit offsets from timestamp_ns
+// (saturating at ~4.29s). Variable-size payloads live in the producer's
+// PayloadPool and only their slot handle travels through the queues. Build
+// with -DROUTER_WIDE_MESSAGE for a full-line variant that also carries an
+// inline payload.
+#if defined(ROUTER_WIDE_MESSAGE)
+constexpr size_t MESSAGE_BYTES = 64;
+#else
+constexpr size_t MESSAGE_BYTES = 32;
+#endif
+
+struct alignas(MESSAGE_BYTES) Message {
+    uint8_t msg_type;
+    uint8_t producer_id;
+    uint8_t processor_id;
+    uint8_t flags;
+    uint32_t sequence;
+    uint64_t timestamp_ns;
+    uint32_t dequeued_offset_ns;   // processor dequeue, relative to timestamp_ns
+    uint32_t processed_offset_ns;  // end of processor work, relative to timestamp_ns
+    uint32_t payload_slot;         // slot in payload_pools[producer_id], unless inline
+    uint32_t payload_bytes;        // 0 when there is no payload
+#if defined(ROUTER_WIDE_MESSAGE)
+    std::array<uint8_t, MESSAGE_BYTES - 32> payload;
+#endif
+};
+static_assert(sizeof(Message) == MESSAGE_BYTES);
+
+inline uint32_t offset_ns(uint64_t t, uint64_t base) {
+    return t > base ? (uint32_t)std::min<uint64_t>(t - base, UINT32_MAX) : 0;
+}
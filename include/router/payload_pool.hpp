@@ -0,0 +1,93 @@
+// Per-producer payload slabs; messages carry slot handles into them.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "queues.hpp"
+
+// ==========================================================
+// Payload Pool
+// ==========================================================
+// Fixed-size slots carved out of one slab per producer. Only the owning
+// producer acquires; any consumer releases by pushing the slot onto a
+// lock-free list. The owner takes that whole list in a single exchange when
+// its private free stack runs dry, so there is no pop race (and no ABA) and
+// no heap traffic per message. The slab is not touched until the owner
+// prefaults it, so its pages land on the producer's node.
+class PayloadPool {
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    PayloadPool(size_t slots, size_t slot_bytes)
+        : slot_bytes_((slot_bytes + 63) & ~(size_t)63), slots_(slots),
+          slab_(static_cast<uint8_t*>(std::aligned_alloc(4096, round_up(slots * slot_bytes_, 4096)))),
+          next_(new std::atomic<uint32_t>[slots]) {
+        if (!slab_) throw std::bad_alloc();
+        local_.reserve(slots);
+        for (size_t i = slots; i-- > 0;) local_.push_back((uint32_t)i);
+    }
+
+    // Owner only. Returns kNone when every slot is in flight.
+    uint32_t acquire() {
+        if (local_.empty()) {
+            uint32_t slot = returned_.exchange(kNone, std::memory_order_acquire);
+            while (slot != kNone) {
+                local_.push_back(slot);
+                slot = next_[slot].load(std::memory_order_relaxed);
+            }
+            if (local_.empty()) return kNone;
+        }
+        uint32_t slot = local_.back();
+        local_.pop_back();
+        return slot;
+    }
+
+    // Any thread, after it has finished reading the slot.
+    void release(uint32_t slot) {
+        uint32_t head = returned_.load(std::memory_order_relaxed);
+        do {
+            next_[slot].store(head, std::memory_order_relaxed);
+        } while (!returned_.compare_exchange_weak(head, slot, std::memory_order_release,
+                                                 std::memory_order_relaxed));
+    }
+
+    bool can_acquire() const {
+        return !local_.empty() || returned_.load(std::memory_order_relaxed) != kNone;
+    }
+
+    uint8_t* data(uint32_t slot) { return slab_.get() + (size_t)slot * slot_bytes_; }
+    MemoryRegion region() { return {slab_.get(), slots_ * slot_bytes_}; }
+    size_t slot_bytes() const { return slot_bytes_; }
+
+private:
+    struct Free {
+        void operator()(uint8_t* p) const { std::free(p); }
+    };
+
+    static size_t round_up(size_t n, size_t align) { return (n + align - 1) / align * align; }
+
+    size_t slot_bytes_;
+    size_t slots_;
+    std::unique_ptr<uint8_t, Free> slab_;
+    std::unique_ptr<std::atomic<uint32_t>[]> next_;
+    std::vector<uint32_t> local_;
+    alignas(64) std::atomic<uint32_t> returned_{kNone};
+};
+
+// Reads every byte of a payload, as a consumer decoding it would.
+inline uint64_t payload_checksum(const uint8_t* p, size_t n) {
+    uint64_t sum = 0, word;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::memcpy(&word, p + i, 8);
+        sum += word;
+    }
+    for (; i < n; ++i) sum += p[i];
+    return sum;
+}
@@ -0,0 +1,164 @@
+// Hardware event counters for one thread (or a thread and the threads it
+// spawns) over perf_event_open, shared by the router and the benchmarks.
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+// ==========================================================
+// Hardware Counters
+// ==========================================================
+// One fd per event, user space only, opened disabled. Events the PMU does not
+// have or perf_event_paranoid forbids stay closed and read as unavailable;
+// HITM (loads served from another core's modified line, i.e. false or true
+// sharing) is Intel's MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM and only requested on
+// Intel parts. Counts are scaled up when the kernel multiplexed the PMU.
+class PerfCounters {
+public:
+    enum Event { Cycles, Instructions, L1DMisses, LLCMisses, BranchMisses, Hitm, kEvents };
+
+    static constexpr std::array<const char*, kEvents> kNames = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "hitm"};
+
+    // With inherit, threads the caller creates after open() are counted too;
+    // their counts are added when they exit.
+    explicit PerfCounters(bool inherit = false) : inherit_(inherit) { fds_.fill(-1); }
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (int fd : fds_)
+            if (fd >= 0) close(fd);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Opens the counters for the calling thread; returns whether any opened.
+    bool open() {
+#if defined(__linux__)
+        for (int e = 0; e < kEvents; ++e) {
+            uint32_t type;
+            uint64_t config;
+            if (!event_config((Event)e, type, config)) continue;
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.inherit = inherit_;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds_[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            if (fds_[e] < 0) errors_[e] = std::strerror(errno);
+        }
+#else
+        errors_.fill("not supported on this platform");
+#endif
+        return any();
+    }
+
+    void enable() { control(true); }
+    void disable() { control(false); }
+
+    bool available(Event e) const { return fds_[e] >= 0; }
+
+    bool any() const {
+        for (int fd : fds_)
+            if (fd >= 0) return true;
+        return false;
+    }
+
+    // Why e was refused; empty if it opened or was not requested on this CPU.
+    const std::string& error(Event e) const { return errors_[e]; }
+
+    // Count while enabled; 0 for an unavailable event.
+    uint64_t value(Event e) const {
+#if defined(__linux__)
+        if (fds_[e] < 0) return 0;
+        uint64_t data[3]; // value, time enabled, time running
+        if (read(fds_[e], data, sizeof(data)) != (ssize_t)sizeof(data)) return 0;
+        if (data[2] == 0) return 0;
+        return data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+#else
+        return 0;
+#endif
+    }
+
+    // Calls sink(name, count / items) for every available event, plus "ipc".
+    template <typename Sink>
+    void per_item(uint64_t items, Sink&& sink) const {
+        if (items == 0) return;
+        for (int e = 0; e < kEvents; ++e)
+            if (available((Event)e)) sink(kNames[e], (double)value((Event)e) / items);
+        if (available(Cycles) && available(Instructions) && value(Cycles))
+            sink("ipc", (double)value(Instructions) / value(Cycles));
+    }
+
+private:
+    static bool event_config(Event e, uint32_t& type, uint64_t& config) {
+#if defined(__linux__)
+        auto cache = [&](uint64_t id) {
+            type = PERF_TYPE_HW_CACHE;
+            config = id | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            return true;
+        };
+        type = PERF_TYPE_HARDWARE;
+        switch (e) {
+            case Cycles: config = PERF_COUNT_HW_CPU_CYCLES; return true;
+            case Instructions: config = PERF_COUNT_HW_INSTRUCTIONS; return true;
+            case L1DMisses: return cache(PERF_COUNT_HW_CACHE_L1D);
+            case LLCMisses: return cache(PERF_COUNT_HW_CACHE_LL);
+            case BranchMisses: config = PERF_COUNT_HW_BRANCH_MISSES; return true;
+            case Hitm:
+                if (!intel()) return false;
+                type = PERF_TYPE_RAW;
+                config = 0x04d2; // event 0xd2, umask 0x04
+                return true;
+            case kEvents: break;
+        }
+#endif
+        return false;
+    }
+
+    static bool intel() {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) return false;
+        char vendor[13];
+        std::memcpy(vendor, &ebx, 4);
+        std::memcpy(vendor + 4, &edx, 4);
+        std::memcpy(vendor + 8, &ecx, 4);
+        vendor[12] = 0;
+        return std::strcmp(vendor, "GenuineIntel") == 0;
+#else
+        return false;
+#endif
+    }
+
+    void control(bool on) {
+#if defined(__linux__)
+        for (int fd : fds_)
+            if (fd >= 0) ioctl(fd, on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    bool inherit_;
+    std::array<int, kEvents> fds_;
+    std::array<std::string, kEvents> errors_;
+};
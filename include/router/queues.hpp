@@ -0,0 +1,525 @@
+// Lock-free rings shared by the router and the benchmarks: SPSCQueue,
+// SPSCByteRing and the Vyukov MPMCQueue, over mmap-backed RingStorage.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// ==========================================================
+// Queue Storage
+// ==========================================================
+// How ring buffers are backed:
+//   none        - plain anonymous mapping (base pages)
+//   transparent - 2MB-aligned mapping with madvise(MADV_HUGEPAGE)
+//   explicit    - MAP_HUGETLB from the reserved pool, falling back to
+//                 transparent when the pool is empty
+// Pages are not touched here; each consumer prefaults its own rings before
+// the run starts (see place_consumer).
+enum class HugePages { None, Transparent, Explicit };
+
+inline HugePages parse_huge_pages(const std::string& name) {
+    if (name == "none") return HugePages::None;
+    if (name == "transparent") return HugePages::Transparent;
+    if (name == "explicit") return HugePages::Explicit;
+    throw std::runtime_error("Unknown huge_pages: " + name);
+}
+
+inline const char* huge_pages_name(HugePages mode) {
+    switch (mode) {
+        case HugePages::None: return "none";
+        case HugePages::Transparent: return "transparent";
+        case HugePages::Explicit: return "explicit";
+    }
+    return "?";
+}
+
+struct QueueSpec {
+    size_t capacity; // slots, power of two
+    HugePages huge_pages = HugePages::None;
+    bool owner_init = false; // MPMCQueue: leave the cells to init_cells() on the owning thread
+};
+
+// A queue's backing memory, for NUMA binding and prefaulting.
+struct MemoryRegion {
+    void* data;
+    size_t bytes;
+};
+
+// Rings whose MAP_HUGETLB request fell back to transparent huge pages.
+inline std::atomic<int> hugetlb_fallbacks{0};
+
+// Ring mappings kept after their ring is destroyed, keyed by size and
+// backing. Only enabled for batch runs: the next scenario's rings take them
+// back with their pages already faulted in.
+//
+// The pages stay on whatever NUMA node they were first faulted on, so a
+// scenario that places queue memory sets bypass(): its rings are mapped
+// fresh for their consumers to fault in, and unmapped when it ends.
+class MappingCache {
+public:
+    void enable() { enabled_ = true; }
+    void bypass(bool on) { bypassed_ = on; }
+
+    void* take(size_t bytes, HugePages mode) {
+        if (bypassed_) return nullptr;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < free_.size(); ++i) {
+            if (free_[i].bytes != bytes || free_[i].mode != mode) continue;
+            void* p = free_[i].data;
+            free_[i] = free_.back();
+            free_.pop_back();
+            return p;
+        }
+        return nullptr;
+    }
+
+    // False when caching is off; the caller unmaps.
+    bool give(void* data, size_t bytes, HugePages mode) {
+        if (!enabled_ || bypassed_) return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back({data, bytes, mode});
+        return true;
+    }
+
+private:
+    struct Entry {
+        void* data;
+        size_t bytes;
+        HugePages mode;
+    };
+
+    std::mutex mutex_;
+    std::vector<Entry> free_;
+    bool enabled_ = false;
+    bool bypassed_ = false;
+};
+
+inline MappingCache ring_mappings;
+
+template <typename T>
+class RingStorage {
+public:
+    static constexpr size_t kHugePageBytes = 2u << 20;
+
+    RingStorage(size_t count, HugePages mode) : count_(count), mode_(mode) {
+        const size_t want = count * sizeof(T);
+        const size_t align = mode == HugePages::None ? (size_t)sysconf(_SC_PAGESIZE) : kHugePageBytes;
+        bytes_ = round_up(want, align);
+        data_ = ring_mappings.take(bytes_, mode);
+        bool mapped = data_ != nullptr;
+#if defined(MAP_HUGETLB)
+        if (!mapped && mode == HugePages::Explicit) {
+            void* p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                data_ = p;
+                mapped = true;
+            } else {
+                hugetlb_fallbacks.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+#endif
+        if (!mapped) {
+            map_aligned(align);
+#if defined(MADV_HUGEPAGE)
+            if (mode != HugePages::None) madvise(data_, bytes_, MADV_HUGEPAGE);
+#endif
+        }
+        if constexpr (!std::is_trivially_default_constructible_v<T>)
+            for (size_t i = 0; i < count_; ++i) new (data() + i) T();
+    }
+
+    ~RingStorage() {
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            for (size_t i = 0; i < count_; ++i) data()[i].~T();
+        if (!ring_mappings.give(data_, bytes_, mode_)) munmap(data_, bytes_);
+    }
+
+    RingStorage(const RingStorage&) = delete;
+    RingStorage& operator=(const RingStorage&) = delete;
+
+    T* data() const { return static_cast<T*>(data_); }
+    size_t bytes() const { return bytes_; }
+
+private:
+    static size_t round_up(size_t n, size_t align) { return (n + align - 1) / align * align; }
+
+    // Over-maps by one alignment unit and trims both ends, so a huge-page
+    // candidate starts on a huge-page boundary.
+    void map_aligned(size_t align) {
+        const size_t span = bytes_ + align;
+        void* p = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        const uintptr_t base = (uintptr_t)p;
+        const uintptr_t start = round_up(base, align);
+        if (start > base) munmap(p, start - base);
+        const uintptr_t end = start + bytes_;
+        if (base + span > end) munmap((void*)end, base + span - end);
+        data_ = (void*)start;
+    }
+
+    size_t count_;
+    HugePages mode_;
+    size_t bytes_ = 0;
+    void* data_ = nullptr;
+};
+
+// ==========================================================
+// Lock-Free Single Producer Single Consumer Queue
+// ==========================================================
+// head_ and tail_ are free-running counters on separate cache lines; slots are
+// addressed with a mask. Each side keeps a private copy of the other side's
+// index and only reloads the shared atomic when that copy says full/empty.
+// The capacity is set at runtime; the buffer pointer and mask are never
+// written after construction.
+template <typename T>
+class SPSCQueue {
+public:
+    explicit SPSCQueue(const QueueSpec& spec)
+        : storage_(spec.capacity, spec.huge_pages), buffer_(storage_.data()),
+          capacity_(spec.capacity), mask_(spec.capacity - 1),
+          head_(0), tail_cache_(0), tail_(0), head_cache_(0) {
+        if (capacity_ < 2 || !std::has_single_bit(capacity_))
+            throw std::runtime_error("SPSCQueue capacity must be a power of two");
+    }
+
+    bool push(const T& item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ == capacity_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head - tail_cache_ == capacity_)
+                return false; // full
+        }
+        buffer_[head & mask_] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_cache_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail == head_cache_)
+                return false; // empty
+        }
+        item = buffer_[tail & mask_];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pushes up to n items, returns how many were accepted.
+    size_t push_bulk(const T* items, size_t n) {
+        auto span = reserve(n);
+        size_t done = span.size();
+        std::copy_n(items, done, span.begin());
+        if (done < n) {
+            // reserve() stops at the wrap point; the rest may fit at the front
+            commit(done);
+            auto rest = reserve(n - done);
+            std::copy_n(items + done, rest.size(), rest.begin());
+            commit(rest.size());
+            return done + rest.size();
+        }
+        commit(done);
+        return done;
+    }
+
+    // Pops up to max items into out, returns how many were taken.
+    size_t pop_bulk(T* out, size_t max) {
+        size_t done = 0;
+        for (int pass = 0; pass < 2 && done < max; ++pass) {
+            auto span = peek(max - done);
+            if (span.empty()) break;
+            std::copy(span.begin(), span.end(), out + done);
+            release(span.size());
+            done += span.size();
+        }
+        return done;
+    }
+
+    // Zero-copy producer side: a contiguous run of up to max free slots.
+    // Fill a prefix of it, then publish with commit().
+    std::span<T> reserve(size_t max) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        size_t free = capacity_ - (head - tail_cache_);
+        if (free < max) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            free = capacity_ - (head - tail_cache_);
+        }
+        size_t idx = head & mask_;
+        size_t n = std::min({max, free, capacity_ - idx});
+        return {buffer_ + idx, n};
+    }
+
+    void commit(size_t n) {
+        head_.store(head_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // Zero-copy consumer side: a contiguous run of up to max ready slots.
+    // Consume a prefix of it, then hand the slots back with release().
+    std::span<T> peek(size_t max) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t avail = head_cache_ - tail;
+        if (avail < max) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            avail = head_cache_ - tail;
+        }
+        size_t idx = tail & mask_;
+        size_t n = std::min({max, avail, capacity_ - idx});
+        return {buffer_ + idx, n};
+    }
+
+    void release(size_t n) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    size_t size() const {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto head = head_.load(std::memory_order_relaxed);
+        return head > tail ? std::min(head - tail, capacity_) : 0;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    void* storage() { return buffer_; }
+    size_t storage_bytes() const { return storage_.bytes(); }
+
+private:
+    RingStorage<T> storage_;
+    T* const buffer_;
+    const size_t capacity_;
+    const size_t mask_;
+    // Producer-owned line
+    alignas(64) std::atomic<size_t> head_;
+    size_t tail_cache_;
+    // Consumer-owned line
+    alignas(64) std::atomic<size_t> tail_;
+    size_t head_cache_;
+};
+
+// ==========================================================
+// Lock-Free SPSC Byte Ring (variable-size records)
+// ==========================================================
+// Length-prefixed records stored back to back, so a 40B record takes 48
+// bytes of ring instead of a max-size slot. A record never straddles the
+// wrap point: if it does not fit before the end, the rest of the lap is
+// marked as padding and the record starts at offset 0, as in a BipBuffer.
+// Positions are free-running byte counters with the same cached remote
+// index scheme as SPSCQueue; record counts ride along for size().
+template <size_t Capacity>
+class SPSCByteRing {
+    static_assert(Capacity >= 64 && (Capacity & (Capacity - 1)) == 0,
+                  "SPSCByteRing capacity must be a power of two");
+    static constexpr size_t kMask = Capacity - 1;
+    static constexpr size_t kHeader = 8;
+    static constexpr uint32_t kPadding = UINT32_MAX;
+
+    static constexpr size_t record_bytes(size_t n) { return (kHeader + n + 7) & ~(size_t)7; }
+
+public:
+    static constexpr size_t kMaxRecord = Capacity / 2 - kHeader;
+
+    // Producer: contiguous space for an n-byte record (n <= kMaxRecord), or
+    // an empty span if the ring is too full. Fill it, then commit().
+    std::span<uint8_t> reserve(size_t n) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t pad = padding_before(head, n);
+        if (Capacity - (head - tail_cache_) < pad + record_bytes(n)) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (Capacity - (head - tail_cache_) < pad + record_bytes(n))
+                return {};
+        }
+        if (pad) store_header(head, kPadding);
+        reserved_pad_ = pad;
+        return {buffer_.data() + ((head + pad) & kMask) + kHeader, n};
+    }
+
+    // Publishes the last reserved record, trimmed to n bytes.
+    void commit(size_t n) {
+        const size_t pos = head_.load(std::memory_order_relaxed) + reserved_pad_;
+        store_header(pos, (uint32_t)n);
+        pushed_.store(pushed_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        head_.store(pos + record_bytes(n), std::memory_order_release);
+    }
+
+    // Producer side: whether reserve(n) would currently succeed.
+    bool can_reserve(size_t n) const {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        return Capacity - (head - tail_.load(std::memory_order_acquire)) >=
+               padding_before(head, n) + record_bytes(n);
+    }
+
+    // Consumer: the next record after the last one peeked, or an empty span.
+    // Peeked records stay valid until release() hands them all back at once.
+    std::span<const uint8_t> peek() {
+        for (;;) {
+            if (read_ == head_cache_) {
+                head_cache_ = head_.load(std::memory_order_acquire);
+                if (read_ == head_cache_)
+                    return {};
+            }
+            const size_t idx = read_ & kMask;
+            uint32_t len;
+            std::memcpy(&len, buffer_.data() + idx, sizeof(len));
+            if (len == kPadding) {
+                read_ += Capacity - idx;
+                continue;
+            }
+            read_ += record_bytes(len);
+            ++read_records_;
+            return {buffer_.data() + idx + kHeader, len};
+        }
+    }
+
+    void release() {
+        popped_.store(read_records_, std::memory_order_relaxed);
+        tail_.store(read_, std::memory_order_release);
+    }
+
+    // Records in flight.
+    size_t size() const {
+        size_t popped = popped_.load(std::memory_order_relaxed);
+        size_t pushed = pushed_.load(std::memory_order_relaxed);
+        return pushed > popped ? pushed - popped : 0;
+    }
+
+    void* storage() { return buffer_.data(); }
+    static constexpr size_t storage_bytes() { return Capacity; }
+
+private:
+    static size_t padding_before(size_t head, size_t n) {
+        const size_t left = Capacity - (head & kMask);
+        return left < record_bytes(n) ? left : 0;
+    }
+
+    void store_header(size_t pos, uint32_t len) {
+        std::memcpy(buffer_.data() + (pos & kMask), &len, sizeof(len));
+    }
+
+    // Producer-owned line
+    alignas(64) std::atomic<size_t> head_{0};
+    std::atomic<size_t> pushed_{0};
+    size_t tail_cache_ = 0;
+    size_t reserved_pad_ = 0;
+    // Consumer-owned line
+    alignas(64) std::atomic<size_t> tail_{0};
+    std::atomic<size_t> popped_{0};
+    size_t head_cache_ = 0;
+    size_t read_ = 0;
+    size_t read_records_ = 0;
+    alignas(64) std::array<uint8_t, Capacity> buffer_;
+};
+
+// ==========================================================
+// Lock-Free Bounded Multi Producer Queue (Vyukov)
+// ==========================================================
+// Each cell carries a sequence number that tells producers and consumers
+// whether the slot is free for the current lap, so concurrent writers never
+// touch the same slot. Used as the MPSC stage-1 ingress.
+//
+// The sequence numbers have to be written before first use, which faults in
+// every page of the ring. With owner_init the constructor leaves that to
+// init_cells(), called from the thread that owns the queue once it is placed,
+// as the SPSC rings are prefaulted by their consumer.
+template <typename T>
+class MPMCQueue {
+public:
+    explicit MPMCQueue(const QueueSpec& spec)
+        : storage_(spec.capacity, spec.huge_pages), cells_(storage_.data()),
+          capacity_(spec.capacity), mask_(spec.capacity - 1),
+          enqueue_pos_(0), dequeue_pos_(0) {
+        if (!std::has_single_bit(capacity_))
+            throw std::runtime_error("MPMCQueue capacity must be a power of two");
+        if (!spec.owner_init) init_cells();
+    }
+
+    // Only before the queue is shared with other threads.
+    void init_cells() {
+        for (size_t i = 0; i < capacity_; ++i)
+            seq(cells_[i]).store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const T& item) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            intptr_t diff = (intptr_t)seq(*cell).load(std::memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = item;
+        seq(*cell).store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            intptr_t diff = (intptr_t)seq(*cell).load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        item = cell->data;
+        seq(*cell).store(pos + capacity_, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        auto enq = enqueue_pos_.load(std::memory_order_relaxed);
+        auto deq = dequeue_pos_.load(std::memory_order_relaxed);
+        return enq > deq ? std::min(enq - deq, capacity_) : 0;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    void* storage() { return cells_; }
+    size_t storage_bytes() const { return storage_.bytes(); }
+
+private:
+    // A plain seq keeps Cell trivially constructible, so RingStorage does not
+    // touch the ring either; it is only ever accessed atomically.
+    struct Cell {
+        size_t seq;
+        T data;
+    };
+    static_assert(std::atomic_ref<size_t>::required_alignment <= alignof(size_t));
+
+    static std::atomic_ref<size_t> seq(Cell& cell) { return std::atomic_ref<size_t>(cell.seq); }
+
+    RingStorage<Cell> storage_;
+    Cell* const cells_;
+    const size_t capacity_;
+    const size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_;
+    alignas(64) std::atomic<size_t> dequeue_pos_;
+};
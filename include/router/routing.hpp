@@ -0,0 +1,484 @@
+// The queues between pipeline stages: stage-1 ingress in each topology,
+// the per-writer lane sets behind it and stage 2, and the per-processor
+// outbox that routes messages to their strategies; and the routing policies
+// that decide which queue a message takes.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "message.hpp"
+#include "queues.hpp"
+
+// ==========================================================
+// Stage-1 Topologies
+// ==========================================================
+// How producers reach the stage-1 processors:
+//   shared - one SPSC queue per processor written by every producer (legacy,
+//            only correct with a single producer)
+//   lanes  - a producer x processor matrix of SPSC lanes, polled round-robin
+//   mpsc   - one bounded lock-free multi-producer ring per processor
+//   byte_lanes - like lanes, but each lane is an SPSCByteRing holding the
+//            Message followed by its payload inline
+enum class IngressTopology { Shared, Lanes, Mpsc, ByteLanes };
+
+inline IngressTopology parse_ingress_topology(const std::string& name) {
+    if (name == "shared") return IngressTopology::Shared;
+    if (name == "lanes") return IngressTopology::Lanes;
+    if (name == "mpsc") return IngressTopology::Mpsc;
+    if (name == "byte_lanes") return IngressTopology::ByteLanes;
+    throw std::runtime_error("Unknown stage1_ingress: " + name);
+}
+
+inline const char* ingress_topology_name(IngressTopology t) {
+    switch (t) {
+        case IngressTopology::Shared: return "shared";
+        case IngressTopology::Lanes: return "lanes";
+        case IngressTopology::Mpsc: return "mpsc";
+        case IngressTopology::ByteLanes: return "byte_lanes";
+    }
+    return "?";
+}
+
+constexpr size_t BYTE_RING_SIZE = 1 << 20;
+using ByteRing = SPSCByteRing<BYTE_RING_SIZE>;
+
+// ==========================================================
+// SPSC Lane Set
+// ==========================================================
+// One consumer fed by several writers, each through its own SPSC lane, so
+// every lane keeps the single-producer contract. The consumer drains lanes
+// round-robin, resuming after the lane served last so one busy writer cannot
+// starve the others.
+class SPSCLaneSet {
+public:
+    SPSCLaneSet(int writer_count, const QueueSpec& spec) {
+        for (int i = 0; i < writer_count; ++i)
+            lanes_.push_back(std::make_unique<SPSCQueue<Message>>(spec));
+    }
+
+    SPSCQueue<Message>& lane(int writer) { return *lanes_[writer]; }
+    const SPSCQueue<Message>& lane(int writer) const { return *lanes_[writer]; }
+
+    size_t pop_bulk(Message* out, size_t max) {
+        const size_t count = lanes_.size();
+        size_t n = 0;
+        for (size_t i = 0; i < count && n < max; ++i) {
+            size_t w = (next_ + i) % count;
+            size_t got = lanes_[w]->pop_bulk(out + n, max - n);
+            if (got) {
+                n += got;
+                next_ = w + 1;
+            }
+        }
+        return n;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (auto& l : lanes_) total += l->size();
+        return total;
+    }
+
+    void append_regions(std::vector<MemoryRegion>& out) {
+        for (auto& l : lanes_) out.push_back({l->storage(), l->storage_bytes()});
+    }
+
+private:
+    std::vector<std::unique_ptr<SPSCQueue<Message>>> lanes_;
+    alignas(64) size_t next_ = 0; // consumer-owned cursor
+};
+
+// Byte-ring counterpart of SPSCLaneSet. Records are a Message header followed
+// by payload_bytes of payload; pop_bulk() copies out the header and hands the
+// payload, still in the ring, to sink before the records are released.
+class ByteLaneSet {
+public:
+    explicit ByteLaneSet(int writer_count) {
+        for (int i = 0; i < writer_count; ++i)
+            lanes_.push_back(std::make_unique<ByteRing>());
+    }
+
+    ByteRing& lane(int writer) { return *lanes_[writer]; }
+    const ByteRing& lane(int writer) const { return *lanes_[writer]; }
+
+    template <typename PayloadSink>
+    size_t pop_bulk(Message* out, size_t max, PayloadSink&& sink) {
+        const size_t count = lanes_.size();
+        size_t n = 0;
+        for (size_t i = 0; i < count && n < max; ++i) {
+            size_t w = (next_ + i) % count;
+            ByteRing& ring = *lanes_[w];
+            size_t got = 0;
+            for (std::span<const uint8_t> rec; n + got < max && !(rec = ring.peek()).empty(); ++got) {
+                Message& msg = out[n + got];
+                std::memcpy(&msg, rec.data(), sizeof(Message));
+                sink(rec.data() + sizeof(Message), msg.payload_bytes);
+            }
+            if (got) {
+                ring.release();
+                n += got;
+                next_ = w + 1;
+            }
+        }
+        return n;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (auto& l : lanes_) total += l->size();
+        return total;
+    }
+
+    void append_regions(std::vector<MemoryRegion>& out) {
+        for (auto& l : lanes_) out.push_back({l->storage(), l->storage_bytes()});
+    }
+
+private:
+    std::vector<std::unique_ptr<ByteRing>> lanes_;
+    alignas(64) size_t next_ = 0; // consumer-owned cursor
+};
+
+// ==========================================================
+// Stage-1 Ingress
+// ==========================================================
+// Owns every queue between producers and processors. push() is called by
+// producer threads, pop_bulk() for a given processor by that processor (the
+// monitor only reads sizes).
+class Stage1Ingress {
+public:
+    // max_record bounds sizeof(Message) plus payload on byte lanes.
+    Stage1Ingress(IngressTopology topology, int producer_count, int processor_count,
+                  const QueueSpec& spec, size_t max_record = sizeof(Message))
+        : topology_(topology), max_record_(max_record) {
+        for (int i = 0; i < processor_count; ++i) {
+            switch (topology_) {
+                case IngressTopology::Shared:
+                    shared_.push_back(std::make_unique<SPSCQueue<Message>>(spec));
+                    break;
+                case IngressTopology::Lanes:
+                    lanes_.push_back(std::make_unique<SPSCLaneSet>(producer_count, spec));
+                    break;
+                case IngressTopology::Mpsc:
+                    mpsc_.push_back(std::make_unique<MPMCQueue<Message>>(spec));
+                    break;
+                case IngressTopology::ByteLanes:
+                    bytes_.push_back(std::make_unique<ByteLaneSet>(producer_count));
+                    break;
+            }
+        }
+    }
+
+    // Whether payloads travel inline (reserve()/commit()) instead of by handle.
+    bool inline_payloads() const { return topology_ == IngressTopology::ByteLanes; }
+
+    // Byte lanes only: space for a Message plus payload_bytes, written in
+    // place and published with commit().
+    std::span<uint8_t> reserve(int producer_id, int proc_id, size_t payload_bytes) {
+        return bytes_[proc_id]->lane(producer_id).reserve(sizeof(Message) + payload_bytes);
+    }
+
+    void commit(int producer_id, int proc_id, size_t payload_bytes) {
+        bytes_[proc_id]->lane(producer_id).commit(sizeof(Message) + payload_bytes);
+    }
+
+    // Each operation also comes with an explicit topology argument; a caller
+    // that passes a constant (StaticRouting) lets the switch fold away.
+    IngressTopology topology() const { return topology_; }
+
+    bool push(int producer_id, int proc_id, const Message& msg) {
+        return push(topology_, producer_id, proc_id, msg);
+    }
+
+    bool push(IngressTopology topology, int producer_id, int proc_id, const Message& msg) {
+        switch (topology) {
+            case IngressTopology::Shared: return shared_[proc_id]->push(msg);
+            case IngressTopology::Lanes: return lanes_[proc_id]->lane(producer_id).push(msg);
+            case IngressTopology::Mpsc: return mpsc_[proc_id]->push(msg);
+            case IngressTopology::ByteLanes: {
+                auto span = reserve(producer_id, proc_id, 0);
+                if (span.empty()) return false;
+                std::memcpy(span.data(), &msg, sizeof(Message));
+                commit(producer_id, proc_id, 0);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // sink(data, bytes) sees each inline payload before its ring space is
+    // reused; other topologies never call it.
+    template <typename PayloadSink>
+    size_t pop_bulk(int proc_id, Message* out, size_t max, PayloadSink&& sink) {
+        return pop_bulk(topology_, proc_id, out, max, sink);
+    }
+
+    template <typename PayloadSink>
+    size_t pop_bulk(IngressTopology topology, int proc_id, Message* out, size_t max, PayloadSink&& sink) {
+        switch (topology) {
+            case IngressTopology::Shared: return shared_[proc_id]->pop_bulk(out, max);
+            case IngressTopology::Lanes: return lanes_[proc_id]->pop_bulk(out, max);
+            case IngressTopology::ByteLanes: return bytes_[proc_id]->pop_bulk(out, max, sink);
+            case IngressTopology::Mpsc: {
+                size_t n = 0;
+                auto& q = *mpsc_[proc_id];
+                while (n < max && q.pop(out[n])) ++n;
+                return n;
+            }
+        }
+        return 0;
+    }
+
+    // Whether producer_id currently has room towards proc_id; used as the
+    // wake-up condition of a parked producer.
+    bool can_push(int producer_id, int proc_id) const { return can_push(topology_, producer_id, proc_id); }
+
+    bool can_push(IngressTopology topology, int producer_id, int proc_id) const {
+        switch (topology) {
+            case IngressTopology::Shared: return shared_[proc_id]->size() < shared_[proc_id]->capacity();
+            case IngressTopology::Lanes: {
+                auto& lane = lanes_[proc_id]->lane(producer_id);
+                return lane.size() < lane.capacity();
+            }
+            case IngressTopology::Mpsc: return mpsc_[proc_id]->size() < mpsc_[proc_id]->capacity();
+            case IngressTopology::ByteLanes: return bytes_[proc_id]->lane(producer_id).can_reserve(max_record_);
+        }
+        return true;
+    }
+
+    // With spec.owner_init, proc_id calls this from its own thread before
+    // producers start; only the MPSC rings need it.
+    void init_owned(int proc_id) {
+        if (topology_ == IngressTopology::Mpsc) mpsc_[proc_id]->init_cells();
+    }
+
+    // Queue memory consumed by proc_id, for NUMA placement.
+    std::vector<MemoryRegion> regions(int proc_id) {
+        std::vector<MemoryRegion> out;
+        switch (topology_) {
+            case IngressTopology::Shared:
+                out.push_back({shared_[proc_id]->storage(), shared_[proc_id]->storage_bytes()});
+                break;
+            case IngressTopology::Lanes:
+                lanes_[proc_id]->append_regions(out);
+                break;
+            case IngressTopology::Mpsc:
+                out.push_back({mpsc_[proc_id]->storage(), mpsc_[proc_id]->storage_bytes()});
+                break;
+            case IngressTopology::ByteLanes:
+                bytes_[proc_id]->append_regions(out);
+                break;
+        }
+        return out;
+    }
+
+    size_t size(int proc_id) const {
+        switch (topology_) {
+            case IngressTopology::Shared: return shared_[proc_id]->size();
+            case IngressTopology::Lanes: return lanes_[proc_id]->size();
+            case IngressTopology::Mpsc: return mpsc_[proc_id]->size();
+            case IngressTopology::ByteLanes: return bytes_[proc_id]->size();
+        }
+        return 0;
+    }
+
+private:
+    IngressTopology topology_;
+    size_t max_record_;
+    std::vector<std::unique_ptr<SPSCQueue<Message>>> shared_;
+    std::vector<std::unique_ptr<SPSCLaneSet>> lanes_;
+    std::vector<std::unique_ptr<MPMCQueue<Message>>> mpsc_;
+    std::vector<std::unique_ptr<ByteLaneSet>> bytes_;
+};
+
+// ==========================================================
+// Stage-2 Outbox
+// ==========================================================
+// A processor's routing step: each message of a batch is appended to its
+// strategy's box, then every box goes to that strategy's lane in one bulk
+// push.
+class Stage2Outbox {
+public:
+    explicit Stage2Outbox(int strategy_count) : boxes_(strategy_count), len_(strategy_count, 0) {}
+
+    template <typename Routing>
+    void route(const Routing& routing, const Message& msg) {
+        const int sid = routing.stage2(msg.msg_type);
+        boxes_[sid][len_[sid]++] = msg;
+    }
+
+    // Messages routed to sid since the last take(); the box is left empty.
+    // A box holds one batch (MAX_BATCH messages) at most.
+    std::span<Message> take(int sid) {
+        const size_t n = len_[sid];
+        len_[sid] = 0;
+        return {boxes_[sid].data(), n};
+    }
+
+private:
+    std::vector<std::array<Message, MAX_BATCH>> boxes_;
+    std::vector<size_t> len_;
+};
+
+// ==========================================================
+// Routing Policies
+// ==========================================================
+// How a producer picks among the processors listed for a message type:
+//   round_robin  - cycle through the list
+//   least_loaded - shortest stage-1 queue
+//   p2c          - shorter of two random candidates (power of two choices)
+//   sticky       - fixed choice hashed from producer_id
+enum class BalancePolicy { RoundRobin, LeastLoaded, PowerOfTwo, Sticky };
+
+inline BalancePolicy parse_balance_policy(const std::string& name) {
+    if (name == "round_robin") return BalancePolicy::RoundRobin;
+    if (name == "least_loaded") return BalancePolicy::LeastLoaded;
+    if (name == "p2c") return BalancePolicy::PowerOfTwo;
+    if (name == "sticky") return BalancePolicy::Sticky;
+    throw std::runtime_error("Unknown stage1 balancing policy: " + name);
+}
+
+struct Stage1Route {
+    std::vector<int> processors{0};
+    BalancePolicy policy = BalancePolicy::RoundRobin;
+
+    bool operator==(const Stage1Route&) const = default;
+};
+
+// The part of a scenario's config that routing reads; the router's Config
+// extends it.
+struct RoutingConfig {
+    int producer_count;
+    int processor_count;
+    int strategy_count;
+    IngressTopology stage1_ingress;
+    std::vector<Stage1Route> stage1_routing; // indexed by msg_type
+    std::vector<int> stage2_routing;         // indexed by msg_type
+    std::vector<bool> ordering_required;     // indexed by msg_type
+};
+
+// DynamicRouting forwards to the loaded config. StaticRouting<T> serves a
+// topology generated at build time (router --emit-topology) from constexpr
+// tables, so counts, lookups and the ingress switch fold into the hot loops.
+// Stage-1 types fanned out over several processors still go through
+// Stage1Balancer; fixed_processor() is -1 for them.
+//
+// Routing threads work on their own copy of the policy and call refresh()
+// at batch boundaries; for DynamicRouting that picks up the latest table
+// published to RoutingTables, for StaticRouting it does nothing.
+inline int fixed_processor_of(const Stage1Route& route) {
+    return route.processors.size() == 1 ? route.processors[0] : -1;
+}
+
+// The part of the routing a reload can change. Epoch 0 is the config the
+// scenario started with.
+struct RoutingTable {
+    uint32_t epoch;
+    std::vector<Stage1Route> stage1;
+    std::array<int, MAX_MSG_TYPES> fixed;
+    std::array<int, MAX_MSG_TYPES> stage2;
+
+    RoutingTable(const RoutingConfig& cfg, uint32_t epoch_) : epoch(epoch_), stage1(cfg.stage1_routing) {
+        for (int type = 0; type < MAX_MSG_TYPES; ++type) {
+            fixed[type] = fixed_processor_of(cfg.stage1_routing[type]);
+            stage2[type] = cfg.stage2_routing[type];
+        }
+    }
+
+    bool same_routes(const RoutingTable& other) const { return stage1 == other.stage1 && stage2 == other.stage2; }
+};
+
+// RCU-style publication: the monitor swaps the current table with one
+// release store and keeps the old ones until reclaim() learns that no
+// routing thread reports an older epoch. Only the monitor writes.
+class RoutingTables {
+public:
+    explicit RoutingTables(const RoutingConfig& cfg) { publish(std::make_unique<RoutingTable>(cfg, 0)); }
+
+    const RoutingTable* current() const { return current_.load(std::memory_order_acquire); }
+
+    void publish(std::unique_ptr<RoutingTable> table) {
+        current_.store(table.get(), std::memory_order_release);
+        live_.push_back(std::move(table));
+    }
+
+    // Frees the tables older than oldest, the lowest epoch still in use.
+    void reclaim(uint32_t oldest) {
+        const RoutingTable* cur = current();
+        std::erase_if(live_, [&](const auto& t) { return t->epoch < oldest && t.get() != cur; });
+    }
+
+private:
+    std::atomic<const RoutingTable*> current_{nullptr};
+    std::vector<std::unique_ptr<RoutingTable>> live_;
+};
+
+class DynamicRouting {
+public:
+    DynamicRouting(const RoutingConfig& cfg, const RoutingTables& tables)
+        : cfg_(&cfg), tables_(&tables), table_(tables.current()) {}
+
+    static constexpr bool is_static = false;
+
+    IngressTopology ingress() const { return cfg_->stage1_ingress; }
+    int producer_count() const { return cfg_->producer_count; }
+    int processor_count() const { return cfg_->processor_count; }
+    int strategy_count() const { return cfg_->strategy_count; }
+    int fixed_processor(uint8_t type) const { return table_->fixed[type]; }
+    int stage2(uint8_t type) const { return table_->stage2[type]; }
+    bool ordered(uint8_t type) const { return cfg_->ordering_required[type]; }
+
+    // Whether a newer table was picked up.
+    bool refresh() {
+        const RoutingTable* latest = tables_->current();
+        if (latest == table_) return false;
+        table_ = latest;
+        return true;
+    }
+    uint32_t epoch() const { return table_->epoch; }
+    const std::vector<Stage1Route>& stage1_routes() const { return table_->stage1; }
+
+private:
+    const RoutingConfig* cfg_;
+    const RoutingTables* tables_;
+    const RoutingTable* table_;
+};
+
+template <typename Topology>
+class StaticRouting {
+public:
+    static constexpr bool is_static = true;
+
+    static constexpr IngressTopology ingress() { return Topology::ingress; }
+    static constexpr int producer_count() { return Topology::producer_count; }
+    static constexpr int processor_count() { return Topology::processor_count; }
+    static constexpr int strategy_count() { return Topology::strategy_count; }
+    static constexpr int fixed_processor(uint8_t type) { return Topology::fixed_processor[type]; }
+    static constexpr int stage2(uint8_t type) { return Topology::stage2[type]; }
+    static constexpr bool ordered(uint8_t type) { return Topology::ordered[type]; }
+    static constexpr bool refresh() { return false; }
+    static constexpr uint32_t epoch() { return 0; }
+
+    // Whether cfg describes the topology this binary was generated from;
+    // otherwise why names the first difference.
+    static bool matches(const RoutingConfig& cfg, std::string& why) {
+        if (cfg.stage1_ingress != ingress()) why = "stage1_ingress";
+        else if (cfg.producer_count != producer_count()) why = "producer count";
+        else if (cfg.processor_count != processor_count()) why = "processor count";
+        else if (cfg.strategy_count != strategy_count()) why = "strategy count";
+        for (int type = 0; why.empty() && type < MAX_MSG_TYPES; ++type) {
+            if (fixed_processor_of(cfg.stage1_routing[type]) != fixed_processor(type)) why = "stage1 rules";
+            else if (cfg.stage2_routing[type] != stage2(type)) why = "stage2 rules";
+            else if (cfg.ordering_required[type] != ordered(type)) why = "ordering_required";
+        }
+        return why.empty();
+    }
+};
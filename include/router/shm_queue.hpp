@@ -0,0 +1,231 @@
+// Named POSIX shared-memory segments and the SPSC ring laid out inside one,
+// so pipeline stages can run as separate processes.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ==========================================================
+// Shared-Memory Segment
+// ==========================================================
+// Opens the named segment, creating it at bytes if it does not exist yet;
+// created() tells which happened. A process that finds the segment waits
+// (up to timeout) for its creator to size it. Each process maps the segment
+// at its own address, so whatever lives inside refers to other parts of it
+// by offset from the start, never by pointer.
+class ShmSegment {
+public:
+    ShmSegment(const std::string& name, size_t bytes, std::chrono::milliseconds timeout) : name_(name), bytes_(bytes) {
+        fd_ = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd_ >= 0) {
+            created_ = true;
+            if (ftruncate(fd_, (off_t)bytes) != 0) {
+                int err = errno;
+                ::close(fd_);
+                shm_unlink(name.c_str());
+                throw std::runtime_error("Cannot size shared memory " + name + ": " + std::strerror(err));
+            }
+        } else if (errno == EEXIST) {
+            fd_ = shm_open(name.c_str(), O_RDWR, 0600);
+            if (fd_ < 0) throw error("Cannot open shared memory");
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            struct stat st;
+            while (fstat(fd_, &st) == 0 && (size_t)st.st_size < bytes) {
+                if (st.st_size != 0 || std::chrono::steady_clock::now() > deadline) {
+                    ::close(fd_);
+                    throw std::runtime_error("Shared memory " + name + " has " + std::to_string(st.st_size) +
+                                             " bytes, expected " + std::to_string(bytes) +
+                                             " (another config, or a creator that died)");
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        } else {
+            throw error("Cannot create shared memory");
+        }
+        void* p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            int err = errno;
+            ::close(fd_);
+            if (created_) shm_unlink(name.c_str());
+            throw std::runtime_error("Cannot map shared memory " + name + ": " + std::strerror(err));
+        }
+        base_ = static_cast<uint8_t*>(p);
+    }
+
+    ~ShmSegment() {
+        munmap(base_, bytes_);
+        ::close(fd_);
+    }
+
+    ShmSegment(const ShmSegment&) = delete;
+    ShmSegment& operator=(const ShmSegment&) = delete;
+
+    uint8_t* base() const { return base_; }
+    size_t bytes() const { return bytes_; }
+    bool created() const { return created_; }
+    const std::string& name() const { return name_; }
+
+    // The mapping stays valid; only the name goes away.
+    void unlink() { shm_unlink(name_.c_str()); }
+
+private:
+    std::runtime_error error(const std::string& what) const {
+        return std::runtime_error(what + " " + name_ + ": " + std::strerror(errno));
+    }
+
+    std::string name_;
+    size_t bytes_;
+    int fd_ = -1;
+    uint8_t* base_ = nullptr;
+    bool created_ = false;
+};
+
+// ==========================================================
+// Shared-Memory SPSC Queue
+// ==========================================================
+// The SPSCQueue algorithm with its indices moved into the segment: the ring
+// header holds the capacity, the offset of the slots and the free-running
+// head/tail counters, each on its own line. A ShmSPSCQueue is one process's
+// view of a ring: it resolves the offsets against that process's mapping
+// and keeps the cached copy of the other side's index locally, so each side
+// needs its own view. Slots hold T by value and are written in place, as in
+// the in-process ring.
+struct ShmRingHeader {
+    uint64_t capacity;
+    uint64_t slots_offset; // from the segment start
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory rings need lock-free 64-bit atomics");
+
+template <typename T>
+class ShmSPSCQueue {
+    static_assert(std::is_trivially_copyable_v<T>, "shared-memory slots are copied between processes");
+
+public:
+    // Lays out an empty ring; called once, by whoever created the segment.
+    static void init(uint8_t* base, size_t header_offset, size_t slots_offset, size_t capacity) {
+        if (capacity < 2 || !std::has_single_bit(capacity))
+            throw std::runtime_error("ShmSPSCQueue capacity must be a power of two");
+        auto* h = new (base + header_offset) ShmRingHeader;
+        h->capacity = capacity;
+        h->slots_offset = slots_offset;
+        h->head.store(0, std::memory_order_relaxed);
+        h->tail.store(0, std::memory_order_relaxed);
+    }
+
+    static constexpr size_t slot_bytes(size_t capacity) { return capacity * sizeof(T); }
+
+    ShmSPSCQueue(uint8_t* base, size_t header_offset)
+        : header_(reinterpret_cast<ShmRingHeader*>(base + header_offset)),
+          buffer_(reinterpret_cast<T*>(base + header_->slots_offset)),
+          capacity_(header_->capacity), mask_(capacity_ - 1),
+          tail_cache_(header_->tail.load(std::memory_order_acquire)),
+          head_cache_(header_->head.load(std::memory_order_acquire)) {}
+
+    bool push(const T& item) {
+        const uint64_t head = header_->head.load(std::memory_order_relaxed);
+        if (head - tail_cache_ == capacity_) {
+            tail_cache_ = header_->tail.load(std::memory_order_acquire);
+            if (head - tail_cache_ == capacity_)
+                return false; // full
+        }
+        buffer_[head & mask_] = item;
+        header_->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pushes up to n items, returns how many were accepted.
+    size_t push_bulk(const T* items, size_t n) {
+        size_t done = 0;
+        for (int pass = 0; pass < 2 && done < n; ++pass) {
+            auto span = reserve(n - done);
+            if (span.empty()) break;
+            std::copy_n(items + done, span.size(), span.begin());
+            commit(span.size());
+            done += span.size();
+        }
+        return done;
+    }
+
+    // Pops up to max items into out, returns how many were taken.
+    size_t pop_bulk(T* out, size_t max) {
+        size_t done = 0;
+        for (int pass = 0; pass < 2 && done < max; ++pass) {
+            auto span = peek(max - done);
+            if (span.empty()) break;
+            std::copy(span.begin(), span.end(), out + done);
+            release(span.size());
+            done += span.size();
+        }
+        return done;
+    }
+
+    std::span<T> reserve(size_t max) {
+        const uint64_t head = header_->head.load(std::memory_order_relaxed);
+        size_t free = capacity_ - (head - tail_cache_);
+        if (free < max) {
+            tail_cache_ = header_->tail.load(std::memory_order_acquire);
+            free = capacity_ - (head - tail_cache_);
+        }
+        size_t idx = head & mask_;
+        size_t n = std::min({max, free, capacity_ - idx});
+        return {buffer_ + idx, n};
+    }
+
+    void commit(size_t n) {
+        header_->head.store(header_->head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    std::span<T> peek(size_t max) {
+        const uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+        size_t avail = head_cache_ - tail;
+        if (avail < max) {
+            head_cache_ = header_->head.load(std::memory_order_acquire);
+            avail = head_cache_ - tail;
+        }
+        size_t idx = tail & mask_;
+        size_t n = std::min({max, avail, capacity_ - idx});
+        return {buffer_ + idx, n};
+    }
+
+    void release(size_t n) {
+        header_->tail.store(header_->tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    size_t size() const {
+        auto tail = header_->tail.load(std::memory_order_relaxed);
+        auto head = header_->head.load(std::memory_order_relaxed);
+        return head > tail ? std::min<size_t>(head - tail, capacity_) : 0;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    void* storage() { return buffer_; }
+    size_t storage_bytes() const { return slot_bytes(capacity_); }
+
+private:
+    ShmRingHeader* const header_;
+    T* const buffer_;
+    const size_t capacity_;
+    const size_t mask_;
+    uint64_t tail_cache_; // used by the producer-side view
+    uint64_t head_cache_; // used by the consumer-side view
+};
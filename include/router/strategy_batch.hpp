@@ -0,0 +1,115 @@
+// Structure-of-arrays buffer that a batched strategy coalesces messages
+// into, and the example batch handler run over it.
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "message.hpp"
+
+constexpr size_t MAX_COALESCE = 1024;
+
+// ==========================================================
+// Per-Type Aggregates
+// ==========================================================
+// What the example handler computes: messages and summed send-to-done
+// latency per msg_type.
+struct TypeAggregates {
+    std::array<uint64_t, MAX_MSG_TYPES> count{};
+    std::array<uint64_t, MAX_MSG_TYPES> latency_ns{};
+
+    void add(uint8_t type, uint64_t latency) {
+        ++count[type];
+        latency_ns[type] += latency;
+    }
+
+    void merge(const TypeAggregates& other) {
+        for (int t = 0; t < MAX_MSG_TYPES; ++t) {
+            count[t] += other.count[t];
+            latency_ns[t] += other.latency_ns[t];
+        }
+    }
+};
+
+// ==========================================================
+// Strategy Batch
+// ==========================================================
+// One column per field the handler and the latency bookkeeping read;
+// columns are 32-byte aligned so the handler can use aligned loads.
+struct StrategyBatch {
+    alignas(32) std::array<uint64_t, MAX_COALESCE> timestamp_ns;
+    alignas(32) std::array<uint64_t, MAX_COALESCE> arrived_ns;  // when the strategy took it
+    alignas(32) std::array<uint32_t, MAX_COALESCE> dequeued_offset_ns;
+    alignas(32) std::array<uint32_t, MAX_COALESCE> processed_offset_ns;
+    alignas(32) std::array<uint8_t, MAX_COALESCE> msg_type;
+    alignas(32) std::array<uint8_t, MAX_COALESCE> flags;
+    alignas(32) std::array<uint8_t, MAX_COALESCE> measured;   // inside the measure window
+    size_t size = 0;
+
+    bool empty() const { return size == 0; }
+    // Arrival of the oldest buffered message, which the deadline counts from.
+    uint64_t oldest_ns() const { return arrived_ns[0]; }
+
+    void add(const Message& msg, uint64_t arrived, bool in_window) {
+        const size_t i = size++;
+        timestamp_ns[i] = msg.timestamp_ns;
+        arrived_ns[i] = arrived;
+        dequeued_offset_ns[i] = msg.dequeued_offset_ns;
+        processed_offset_ns[i] = msg.processed_offset_ns;
+        msg_type[i] = msg.msg_type;
+        flags[i] = msg.flags;
+        measured[i] = in_window;
+    }
+};
+
+// Example batch handler: per-type counts and latency sums up to done_ns.
+// Every message of a batch completes at done_ns, so a type's latency sum is
+// count * done_ns - sum(timestamp_ns) and the loop only needs masked sums
+// of the timestamp column: four messages per step, one 64-bit lane each.
+inline void aggregate_by_type(const StrategyBatch& b, uint64_t done_ns, TypeAggregates& agg) {
+    std::array<uint64_t, MAX_MSG_TYPES> count{}, ts_sum{};
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i counts[MAX_MSG_TYPES], sums[MAX_MSG_TYPES];
+    for (int t = 0; t < MAX_MSG_TYPES; ++t) counts[t] = sums[t] = _mm256_setzero_si256();
+    for (; i + 4 <= b.size; i += 4) {
+        const __m256i ts = _mm256_load_si256(reinterpret_cast<const __m256i*>(&b.timestamp_ns[i]));
+        int32_t packed;
+        __builtin_memcpy(&packed, &b.msg_type[i], sizeof(packed));
+        const __m256i types = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+        for (int t = 0; t < MAX_MSG_TYPES; ++t) {
+            const __m256i match = _mm256_cmpeq_epi64(types, _mm256_set1_epi64x(t));
+            counts[t] = _mm256_sub_epi64(counts[t], match); // match lanes are -1
+            sums[t] = _mm256_add_epi64(sums[t], _mm256_and_si256(match, ts));
+        }
+    }
+    for (int t = 0; t < MAX_MSG_TYPES; ++t) {
+        alignas(32) uint64_t c[4], s[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(c), counts[t]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(s), sums[t]);
+        count[t] = c[0] + c[1] + c[2] + c[3];
+        ts_sum[t] = s[0] + s[1] + s[2] + s[3];
+    }
+#endif
+    for (; i < b.size; ++i) {
+        ++count[b.msg_type[i]];
+        ts_sum[b.msg_type[i]] += b.timestamp_ns[i];
+    }
+    for (int t = 0; t < MAX_MSG_TYPES; ++t) {
+        agg.count[t] += count[t];
+        agg.latency_ns[t] += count[t] * done_ns - ts_sum[t];
+    }
+}
+
+inline const char* aggregate_kernel_name() {
+#if defined(__AVX2__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
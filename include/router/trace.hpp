@@ -0,0 +1,276 @@
+// Fixed-record binary traces of delivered messages: strategies append to a
+// memory-mapped capture file and producers replay a finished one in place.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "message.hpp"
+
+// ==========================================================
+// Trace Format
+// ==========================================================
+// An 8 KiB header followed by 16-byte records. While capturing, records sit
+// in claim order and time_ns is the message's send timestamp. finish() sorts
+// them by (stream, time) and rewrites time_ns as the gap since the stream's
+// previous record (for a stream's first record: since the trace's earliest
+// record), which is the form replay reads. A stream is one original producer.
+constexpr uint64_t TRACE_MAGIC = 0x31454341525452ull; // "RTRACE1"
+constexpr uint32_t TRACE_VERSION = 1;
+constexpr size_t TRACE_MAX_STREAMS = 256;
+constexpr size_t TRACE_RECORDS_OFFSET = 8192;
+
+struct TraceRecord {
+    uint64_t time_ns;       // send time while capturing, inter-arrival gap once finished
+    uint32_t payload_bytes;
+    uint8_t msg_type;
+    uint8_t stream;         // producer_id at capture
+    uint8_t valid;          // claimed slots never written stay 0
+    uint8_t reserved;
+};
+static_assert(sizeof(TraceRecord) == 16);
+
+struct TraceStream {
+    uint64_t first; // record index
+    uint64_t count;
+};
+
+struct TraceHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_bytes;
+    uint64_t record_count;
+    uint32_t stream_count; // highest stream id + 1
+    uint32_t finished;
+    uint64_t reserved[4];
+    TraceStream streams[TRACE_MAX_STREAMS];
+};
+static_assert(sizeof(TraceHeader) <= TRACE_RECORDS_OFFSET);
+
+inline std::runtime_error trace_error(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+// ==========================================================
+// Trace Capture
+// ==========================================================
+// The file's blocks are allocated up front (posix_fallocate) and every page
+// of the shared mapping is written once in the constructor, before the run,
+// so appending is a store into resident, writable page cache: no syscall,
+// no block allocation (so no SIGBUS on a full disk) and no lock on the
+// delivery path. Writeback may still write-protect a page it has cleaned,
+// which costs the next store a minor fault but no I/O. Each thread appends
+// through its own Appender, which claims kChunk slots at a time with one
+// fetch_add; once the file is full further records are counted as dropped
+// rather than waited for.
+class TraceWriter {
+public:
+    static constexpr size_t kChunk = 4096;
+
+    class Appender {
+    public:
+        explicit Appender(TraceWriter& writer) : writer_(writer) {}
+        ~Appender() { writer_.dropped_.fetch_add(dropped_, std::memory_order_relaxed); }
+
+        Appender(const Appender&) = delete;
+        Appender& operator=(const Appender&) = delete;
+
+        void append(const Message& msg) {
+            if (next_ == end_ && !refill()) {
+                ++dropped_;
+                return;
+            }
+            TraceRecord& r = writer_.records_[next_++];
+            r.time_ns = msg.timestamp_ns;
+            r.payload_bytes = msg.payload_bytes;
+            r.msg_type = msg.msg_type;
+            r.stream = msg.producer_id;
+            r.valid = 1;
+        }
+
+    private:
+        bool refill() {
+            if (full_) return false;
+            size_t first = writer_.claimed_.fetch_add(kChunk, std::memory_order_relaxed);
+            if (first >= writer_.capacity_) {
+                full_ = true;
+                return false;
+            }
+            next_ = first;
+            end_ = std::min(first + kChunk, writer_.capacity_);
+            return true;
+        }
+
+        TraceWriter& writer_;
+        size_t next_ = 0;
+        size_t end_ = 0;
+        bool full_ = false;
+        uint64_t dropped_ = 0;
+    };
+
+    TraceWriter(const std::string& path, size_t capacity) : path_(path), capacity_(capacity) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) throw trace_error("Cannot create trace", path);
+        bytes_ = TRACE_RECORDS_OFFSET + capacity * sizeof(TraceRecord);
+        if (int err = posix_fallocate(fd_, 0, (off_t)bytes_)) {
+            ::close(fd_);
+            errno = err;
+            throw trace_error("Cannot allocate trace", path);
+        }
+        void* p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd_);
+            throw trace_error("Cannot map trace", path);
+        }
+        base_ = static_cast<uint8_t*>(p);
+        records_ = reinterpret_cast<TraceRecord*>(base_ + TRACE_RECORDS_OFFSET);
+        // Write faults happen here rather than in append().
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        for (size_t off = 0; off < bytes_; off += page) static_cast<volatile uint8_t*>(p)[off] = 0;
+    }
+
+    ~TraceWriter() {
+        if (base_) munmap(base_, bytes_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    const std::string& path() const { return path_; }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // Call once every Appender is gone: compacts and sorts the records,
+    // writes the header and cuts the file to what was kept.
+    uint64_t finish() {
+        const size_t claimed = std::min(claimed_.load(std::memory_order_relaxed), capacity_);
+        TraceRecord* end = std::remove_if(records_, records_ + claimed, [](const TraceRecord& r) { return !r.valid; });
+        const size_t n = end - records_;
+        std::sort(records_, end, [](const TraceRecord& a, const TraceRecord& b) {
+            return a.stream != b.stream ? a.stream < b.stream : a.time_ns < b.time_ns;
+        });
+
+        TraceHeader& h = *reinterpret_cast<TraceHeader*>(base_);
+        std::memset(&h, 0, sizeof(h));
+        uint64_t origin = UINT64_MAX;
+        for (size_t i = 0; i < n; ++i) origin = std::min(origin, records_[i].time_ns);
+        for (size_t i = 0; i < n;) {
+            TraceStream& s = h.streams[records_[i].stream];
+            s.first = i;
+            uint64_t prev = origin;
+            for (; i < n && records_[i].stream == records_[s.first].stream; ++i, ++s.count) {
+                uint64_t t = records_[i].time_ns;
+                records_[i].time_ns = t - prev;
+                prev = t;
+            }
+            h.stream_count = records_[s.first].stream + 1u;
+        }
+        h.magic = TRACE_MAGIC;
+        h.version = TRACE_VERSION;
+        h.record_bytes = sizeof(TraceRecord);
+        h.record_count = n;
+        h.finished = 1;
+
+        msync(base_, bytes_, MS_SYNC);
+        munmap(base_, bytes_);
+        base_ = nullptr;
+        if (ftruncate(fd_, (off_t)(TRACE_RECORDS_OFFSET + n * sizeof(TraceRecord))) != 0)
+            throw trace_error("Cannot truncate trace", path_);
+        return n;
+    }
+
+private:
+    std::string path_;
+    size_t capacity_;
+    size_t bytes_ = 0;
+    int fd_ = -1;
+    uint8_t* base_ = nullptr;
+    TraceRecord* records_ = nullptr;
+    std::atomic<size_t> claimed_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+// ==========================================================
+// Trace Replay
+// ==========================================================
+// Maps a finished trace read-only and prefaulted; streams() are spans
+// straight into the mapping, so replay copies and allocates nothing.
+// Empty streams are left out.
+class TraceReader {
+public:
+    explicit TraceReader(const std::string& path) : path_(path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw trace_error("Cannot open trace", path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw trace_error("Cannot stat trace", path);
+        }
+        bytes_ = (size_t)st.st_size;
+        if (bytes_ < TRACE_RECORDS_OFFSET) {
+            ::close(fd);
+            throw std::runtime_error("Not a trace file: " + path);
+        }
+        void* p = mmap(nullptr, bytes_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) throw trace_error("Cannot map trace", path);
+        base_ = static_cast<const uint8_t*>(p);
+        madvise(const_cast<uint8_t*>(base_), bytes_, MADV_SEQUENTIAL);
+
+        const TraceHeader& h = *reinterpret_cast<const TraceHeader*>(base_);
+        const size_t stored = (bytes_ - TRACE_RECORDS_OFFSET) / sizeof(TraceRecord);
+        if (h.magic != TRACE_MAGIC || h.version != TRACE_VERSION || h.record_bytes != sizeof(TraceRecord) ||
+            h.stream_count > TRACE_MAX_STREAMS || h.record_count > stored) {
+            munmap(const_cast<uint8_t*>(base_), bytes_);
+            throw std::runtime_error("Not a trace file (or unsupported version): " + path);
+        }
+        if (!h.finished) {
+            munmap(const_cast<uint8_t*>(base_), bytes_);
+            throw std::runtime_error("Trace was not finished: " + path);
+        }
+        const TraceRecord* records = reinterpret_cast<const TraceRecord*>(base_ + TRACE_RECORDS_OFFSET);
+        for (uint32_t s = 0; s < h.stream_count; ++s) {
+            const TraceStream& st = h.streams[s];
+            if (st.count == 0) continue;
+            if (st.first + st.count > h.record_count) {
+                munmap(const_cast<uint8_t*>(base_), bytes_);
+                throw std::runtime_error("Corrupt trace stream index: " + path);
+            }
+            streams_.emplace_back(records + st.first, st.count);
+        }
+        records_ = {records, h.record_count};
+        if (streams_.empty()) {
+            munmap(const_cast<uint8_t*>(base_), bytes_);
+            throw std::runtime_error("Trace has no records: " + path);
+        }
+    }
+
+    ~TraceReader() { munmap(const_cast<uint8_t*>(base_), bytes_); }
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    const std::string& path() const { return path_; }
+    std::span<const TraceRecord> records() const { return records_; }
+    const std::vector<std::span<const TraceRecord>>& streams() const { return streams_; }
+
+private:
+    std::string path_;
+    const uint8_t* base_ = nullptr;
+    size_t bytes_ = 0;
+    std::span<const TraceRecord> records_;
+    std::vector<std::span<const TraceRecord>> streams_;
+};
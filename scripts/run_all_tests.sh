@@ -7,10 +7,8 @@ cd "$ROOT_DIR"
 RESULTS_DIR=results
 mkdir -p "$RESULTS_DIR"
 
-for cfg in configs/*.json; do
-  name=$(basename "$cfg" .json)
-  echo "Running scenario $name"
-  /usr/local/bin/router "$cfg" "$RESULTS_DIR"
-done
+# One process runs every scenario, reusing its threads and queue memory.
+echo "Running scenarios in configs/"
+/usr/local/bin/router configs "$RESULTS_DIR"
 
-echo "All scenarios completed. Results are in $RESULTS_DIR"
+echo "All scenarios completed. Results are in $RESULTS_DIR (summary: $RESULTS_DIR/results.json)"
@@ -14,6 +14,13 @@ BENCH_TO_RUN=${1:-all}
 
 echo "🔧 Building and running benchmarks..."
 
+# routing_latency_benchmark compiles in benchmarks/baseline_topology.hpp;
+# regenerate it when a router binary is around so it follows the config.
+ROUTER_BIN=$(command -v router || { [ -x ./router ] && echo ./router; } || true)
+if [ -n "$ROUTER_BIN" ]; then
+    "$ROUTER_BIN" --emit-topology configs/baseline.json benchmarks/baseline_topology.hpp >/dev/null
+fi
+
 for SRC in benchmarks/*.cpp; do
     NAME=$(basename "$SRC" .cpp)
     
@@ -26,7 +33,8 @@ for SRC in benchmarks/*.cpp; do
 
     echo "  → Building $NAME..."
     mkdir -p benchmarks/bin
-    if [ ! -f "$BIN" ] || [ "$SRC" -nt "$BIN" ]; then
+    # Rebuild when the benchmark or the headers it uses changed.
+    if [ ! -f "$BIN" ] || [ "$SRC" -nt "$BIN" ] || [ -n "$(find include/router benchmarks -name '*.hpp' -newer "$BIN")" ]; then
         if command -v clang++ >/dev/null 2>&1; then
             clang++ -O3 -march=native -std=c++20 -pthread -Iinclude -I/usr/local/include "$SRC" -lbenchmark -lpthread -o "$BIN"
         elif command -v g++ >/dev/null 2>&1; then
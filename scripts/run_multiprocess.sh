@@ -0,0 +1,30 @@
+#!/bin/bash
+set -euo pipefail
+
+# Runs one scenario with producers, processors and strategies as three
+# processes that meet in shared memory (router --role).
+CONFIG_NAME=${1:-baseline.json}
+RESULTS_DIR=${2:-results}
+ROUTER=${ROUTER:-/usr/local/bin/router}
+
+CONFIG="configs/${CONFIG_NAME}"
+if [ ! -f "$CONFIG" ]; then
+    echo "Error: config file '$CONFIG' does not exist."
+    exit 1
+fi
+mkdir -p "$RESULTS_DIR"
+
+echo "Running scenario from: $CONFIG (one process per stage)"
+pids=()
+for role in strategy processor producer; do
+    "$ROUTER" --role "$role" "$CONFIG" "$RESULTS_DIR" &
+    pids+=($!)
+done
+
+status=0
+for pid in "${pids[@]}"; do
+    wait "$pid" || status=1
+done
+
+echo "Multi-process run completed. Results in $RESULTS_DIR (<scenario>_<role>_summary.txt)"
+exit $status
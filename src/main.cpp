@@ -4,7 +4,6 @@
 #include <thread>
 #include <atomic>
 #include <chrono>
-#include <random>
 #include <algorithm>
 #include <memory>
 #include <string>
@@ -12,72 +11,253 @@
 #include <filesystem>
 #include <cstdint>
 #include <array>
+#include <latch>
+#include <cctype>
+#include <span>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <numeric>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+#include <csignal>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <sys/mman.h>
 #include "../include/json.hpp"
+#include "../include/router/latency_histogram.hpp"
+#include "../include/router/message.hpp"
+#include "../include/router/payload_pool.hpp"
+#include "../include/router/perf_counters.hpp"
+#include "../include/router/queues.hpp"
+#include "../include/router/routing.hpp"
+#include "../include/router/shm_queue.hpp"
+#include "../include/router/strategy_batch.hpp"
+#include "../include/router/trace.hpp"
 
 using json = nlohmann::json;
 
 // ==========================================================
-// Lock-Free Single Producer Single Consumer Queue
+// Config Parsing
 // ==========================================================
-template <typename T, size_t Capacity>
-class SPSCQueue {
-public:
-    SPSCQueue() : head_(0), tail_(0) {}
-
-    bool push(const T& item) {
-        auto head = head_.load(std::memory_order_relaxed);
-        auto next = (head + 1) % Capacity;
-        if (next == tail_.load(std::memory_order_acquire))
-            return false; // full
-        buffer_[head] = item;
-        head_.store(next, std::memory_order_release);
-        return true;
+// How ordering_required types keep per-(producer_id, msg_type) order:
+//   none     - not enforced (violations are still counted)
+//   affinity - stage-1 routing of the type is forced to sticky-by-producer
+//   reorder  - strategies restore order in a bounded reorder buffer
+enum class OrderingMode { None, Affinity, Reorder };
+
+OrderingMode parse_ordering_mode(const std::string& name) {
+    if (name == "none") return OrderingMode::None;
+    if (name == "affinity") return OrderingMode::Affinity;
+    if (name == "reorder") return OrderingMode::Reorder;
+    throw std::runtime_error("Unknown ordering_mode: " + name);
+}
+
+const char* ordering_mode_name(OrderingMode m) {
+    switch (m) {
+        case OrderingMode::None: return "none";
+        case OrderingMode::Affinity: return "affinity";
+        case OrderingMode::Reorder: return "reorder";
     }
+    return "?";
+}
 
-    bool pop(T& item) {
-        auto tail = tail_.load(std::memory_order_relaxed);
-        if (tail == head_.load(std::memory_order_acquire))
-            return false; // empty
-        item = buffer_[tail];
-        tail_.store((tail + 1) % Capacity, std::memory_order_release);
-        return true;
+// Processor scheduling:
+//   static        - each processor handles exactly what stage-1 routes to it
+//   work_stealing - unordered types go through a per-processor steal queue
+//                   that idle peers drain in batches
+enum class ProcessorMode { Static, WorkStealing };
+
+// Strategy execution:
+//   per_message - the handler runs once per delivered message
+//   batched     - messages are coalesced into a StrategyBatch and the handler
+//                 runs once per coalesce_max messages, or once the oldest
+//                 has waited coalesce_max_wait_us.
+// A call costs call_overhead_ns plus processing_times_ns per message it
+// handles, in both modes. With handler "aggregate" the call also folds its
+// messages into per-type counts and latency sums; "busy" (default) is the
+// simulated work alone.
+enum class StrategyMode { PerMessage, Batched };
+
+const char* strategy_mode_name(StrategyMode m) {
+    return m == StrategyMode::Batched ? "batched" : "per_message";
+}
+
+// What a thread does while it cannot make progress:
+//   spin  - busy-spin with a pause hint (lowest latency, always 100% CPU)
+//   yield - spin with exponential backoff, then yield to the scheduler
+//   park  - spin, yield, then sleep on a futex until the other side notifies
+enum class WaitKind { Spin, Yield, Park };
+
+WaitKind parse_wait_kind(const std::string& name) {
+    if (name == "spin") return WaitKind::Spin;
+    if (name == "yield") return WaitKind::Yield;
+    if (name == "park") return WaitKind::Park;
+    throw std::runtime_error("Unknown wait strategy: " + name);
+}
+
+struct WaitConfig {
+    WaitKind producer = WaitKind::Yield;  // stage-1 queue full
+    WaitKind processor = WaitKind::Yield; // stage-1 empty or stage-2 full
+    WaitKind strategy = WaitKind::Yield;  // stage-2 empty
+};
+
+// What happens to traffic for a queue under pressure (per stage):
+//   block       - wait for room
+//   drop_newest - drop the incoming message when the queue is full
+//   drop_oldest - the consumer discards its oldest entries beyond max_depth
+//   sample      - beyond max_depth only every sample_every-th message is
+//                 admitted; a full queue drops
+enum class OverloadPolicy { Block, DropNewest, DropOldest, Sample };
+
+OverloadPolicy parse_overload_policy(const std::string& name) {
+    if (name == "block") return OverloadPolicy::Block;
+    if (name == "drop_newest") return OverloadPolicy::DropNewest;
+    if (name == "drop_oldest") return OverloadPolicy::DropOldest;
+    if (name == "sample") return OverloadPolicy::Sample;
+    throw std::runtime_error("Unknown overload policy: " + name);
+}
+
+const char* overload_policy_name(OverloadPolicy p) {
+    switch (p) {
+        case OverloadPolicy::Block: return "block";
+        case OverloadPolicy::DropNewest: return "drop_newest";
+        case OverloadPolicy::DropOldest: return "drop_oldest";
+        case OverloadPolicy::Sample: return "sample";
     }
+    return "?";
+}
+
+struct OverloadConfig {
+    OverloadPolicy policy = OverloadPolicy::Block;
+    size_t max_depth = 0;      // per consumer, summed over its lanes
+    uint32_t sample_every = 8;
 
-    size_t size() const {
-        auto head = head_.load(std::memory_order_relaxed);
-        auto tail = tail_.load(std::memory_order_relaxed);
-        return (head + Capacity - tail) % Capacity;
+    // Whether the writer gives up on a full queue instead of waiting.
+    bool writer_drops() const {
+        return policy == OverloadPolicy::DropNewest || policy == OverloadPolicy::Sample;
     }
+};
 
-private:
-    std::array<T, Capacity> buffer_;
-    std::atomic<size_t> head_;
-    std::atomic<size_t> tail_;
+constexpr size_t QUEUE_SIZE = 1 << 14; // default queue_capacity
+constexpr size_t STEAL_QUEUE_SIZE = 1 << 12;
+
+// Where message latency is measured from:
+//   send     - when the producer starts the enqueue
+//   intended - the pacer's scheduled send time, so time a producer spends
+//              behind schedule (e.g. blocked on a full queue) is counted
+enum class LatencyOrigin { Send, Intended };
+
+// Where producers get message types from:
+//   alias - sample the configured distribution per message
+//   tape  - replay a per-producer sequence pre-sampled before the run
+//   trace - replay a captured trace file: types, payload sizes and the
+//           original inter-arrival gaps, in place of the rate schedule
+enum class TypeSource { Alias, Tape, Trace };
+
+// Producer send-rate schedule. The rate is per producer; when both burst and
+// quiet durations are set, time since start alternates between a burst phase
+// (rate * burst_multiplier) and a quiet phase (rate * quiet_multiplier).
+struct RateProfile {
+    double messages_per_sec = 0.0; // 0 = unpaced, push as fast as possible
+    double burst_multiplier = 1.0;
+    double quiet_multiplier = 1.0;
+    uint64_t burst_ns = 0;
+    uint64_t quiet_ns = 0;
+
+    bool paced() const { return messages_per_sec > 0.0; }
+    bool bursty() const { return burst_ns > 0 && quiet_ns > 0; }
+
+    bool in_burst(uint64_t elapsed_ns) const {
+        return bursty() && elapsed_ns % (burst_ns + quiet_ns) < burst_ns;
+    }
+
+    double rate_at(uint64_t elapsed_ns) const {
+        if (!bursty()) return messages_per_sec;
+        return messages_per_sec * (in_burst(elapsed_ns) ? burst_multiplier : quiet_multiplier);
+    }
 };
 
-// ==========================================================
-// Message Structure
-// ==========================================================
-struct Message {
-    uint8_t msg_type;
-    uint8_t producer_id;
-    uint32_t sequence;
-    uint64_t timestamp_ns;
-    uint8_t processor_id;
-    uint64_t processed_ns;
+// How queue memory is placed when a placement section is configured:
+//   none        - leave it to the allocator
+//   first_touch - each consumer thread faults in its queues after pinning
+//   mbind       - additionally bind the pages to the consumer's NUMA node
+enum class NumaPolicy { None, FirstTouch, Bind };
+
+// Per-role CPU lists; thread i of a role runs on list[i % size]. An empty
+// list leaves that role unpinned, monitor < 0 leaves the monitor unpinned.
+struct Placement {
+    std::vector<int> producers;
+    std::vector<int> processors;
+    std::vector<int> strategies;
+    int monitor = -1;
+    NumaPolicy numa = NumaPolicy::None;
+
+    static int core_for(const std::vector<int>& cores, int idx) {
+        return cores.empty() ? -1 : cores[idx % cores.size()];
+    }
 };
 
-// ==========================================================
-// Config Parsing
-// ==========================================================
-struct Config {
-    int duration_secs;
-    int producer_count;
-    int processor_count;
-    int strategy_count;
-    std::vector<int> stage1_routing;
-    std::vector<int> stage2_routing;
+struct Config : RoutingConfig {
+    int duration_secs;    // measure window
+    int warmup_secs;      // run before the measure window, not counted
+    uint64_t drain_timeout_ns;
+    int processor_batch;  // max messages a processor drains per wakeup
+    ProcessorMode processor_mode;
+    int steal_batch;      // max messages taken per steal
+    int strategy_batch;   // max messages a strategy drains per wakeup
+    StrategyMode strategy_mode;
+    size_t coalesce_max;  // messages per batched handler call
+    uint64_t coalesce_max_wait_ns;
+    bool strategy_aggregates; // strategies.handler "aggregate"
+    size_t stage1_capacity; // slots per stage-1 queue (processors.queue_capacity)
+    size_t stage2_capacity; // slots per stage-2 lane (strategies.queue_capacity)
+    HugePages huge_pages;
+    bool prefault_queues;
+    OverloadConfig stage1_overload;       // processors.overload
+    OverloadConfig stage2_overload;       // strategies.overload
+    RateProfile rate;
+    WaitConfig wait;
+    Placement placement;
+    std::string clock;
+    LatencyOrigin latency_origin;
+    bool co_correction;               // HdrHistogram-style correction of Total
+    bool metrics_jsonl;               // per-interval metrics as JSON lines
+    bool perf_counters;               // hardware counters per role over the measure window
+    std::vector<double> type_weights; // indexed by msg_type
+    TypeSource type_source;
+    size_t tape_length;               // power of two
+    std::string trace_file;           // producers.trace_file, with type_source trace
+    bool capture_trace;               // write delivered messages to <scenario>_trace.bin
+    size_t capture_max_records;
+    size_t payload_min_bytes;         // payload size is uniform in [min, max]
+    size_t payload_max_bytes;         // 0 disables payloads
+    size_t payload_pool_slots;        // per producer
+    std::vector<uint64_t> processor_cost_ns; // simulated work per msg_type
+    std::vector<uint64_t> strategy_cost_ns;  // simulated work per strategy, per message
+    std::vector<uint64_t> strategy_call_overhead_ns; // per handler call
+    OrderingMode ordering_mode;
+    size_t reorder_window;               // slots per key, power of two
+    uint64_t reorder_max_hold_ns;
+    std::string path;                    // the file it was loaded from
+    bool routing_reload;                 // republish stage1/stage2 rules when the file changes or on SIGHUP
+    uint64_t reload_fence_timeout_ns;    // longest a producer waits to move an ordered type
+    std::string shm_name;                // shared_memory.name for --role; empty: /router_<scenario>
+    uint64_t shm_attach_timeout_ns;      // how long a --role process waits for the others
 };
 
 Config load_config(const std::string& path) {
@@ -89,258 +269,3372 @@ Config load_config(const std::string& path) {
     f >> j;
 
     Config cfg;
+    cfg.path = path;
     cfg.duration_secs = j["duration_secs"];
+    cfg.warmup_secs = j.value("warmup_secs", 0);
+    cfg.drain_timeout_ns = j.value("drain_timeout_ms", 5000) * 1000000ull;
     cfg.producer_count = j["producers"]["count"];
     cfg.processor_count = j["processors"]["count"];
     cfg.strategy_count = j["strategies"]["count"];
+    cfg.stage1_ingress = parse_ingress_topology(j.value("stage1_ingress", "lanes"));
+    cfg.processor_batch = std::clamp(j["processors"].value("batch_size", 32), 1, MAX_BATCH);
+    cfg.strategy_batch = std::clamp(j["strategies"].value("batch_size", 32), 1, MAX_BATCH);
+    cfg.stage1_capacity = j["processors"].value("queue_capacity", QUEUE_SIZE);
+    cfg.stage2_capacity = j["strategies"].value("queue_capacity", QUEUE_SIZE);
+    for (size_t cap : {cfg.stage1_capacity, cfg.stage2_capacity})
+        if (cap < 2 || !std::has_single_bit(cap))
+            throw std::runtime_error("queue_capacity must be a power of two >= 2");
+    cfg.huge_pages = parse_huge_pages(j.value("huge_pages", "transparent"));
+
+    // "overload": "policy", or {"policy": ..., "max_depth": N, "sample_every": K}.
+    auto read_overload = [](const json& section, size_t capacity) {
+        OverloadConfig o;
+        o.max_depth = capacity / 2;
+        if (!section.contains("overload")) return o;
+        const auto& ov = section["overload"];
+        if (ov.is_object()) {
+            o.policy = parse_overload_policy(ov.value("policy", "block"));
+            o.max_depth = ov.value("max_depth", o.max_depth);
+            o.sample_every = std::max(1u, ov.value("sample_every", o.sample_every));
+        } else {
+            o.policy = parse_overload_policy(ov.get<std::string>());
+        }
+        return o;
+    };
+    cfg.stage1_overload = read_overload(j["processors"], cfg.stage1_capacity);
+    cfg.stage2_overload = read_overload(j["strategies"], cfg.stage2_capacity);
+    cfg.prefault_queues = j.value("prefault_queues", true);
+    std::string proc_mode = j["processors"].value("mode", "static");
+    if (proc_mode == "static") cfg.processor_mode = ProcessorMode::Static;
+    else if (proc_mode == "work_stealing") cfg.processor_mode = ProcessorMode::WorkStealing;
+    else throw std::runtime_error("Unknown processors.mode: " + proc_mode);
+    cfg.steal_batch = std::clamp(j["processors"].value("steal_batch", 32), 1, MAX_BATCH);
+
+    std::string strat_mode = j["strategies"].value("mode", "per_message");
+    if (strat_mode == "per_message") cfg.strategy_mode = StrategyMode::PerMessage;
+    else if (strat_mode == "batched") cfg.strategy_mode = StrategyMode::Batched;
+    else throw std::runtime_error("Unknown strategies.mode: " + strat_mode);
+    cfg.coalesce_max = std::clamp(j["strategies"].value("coalesce_max", (size_t)64), (size_t)1, MAX_COALESCE);
+    cfg.coalesce_max_wait_ns = j["strategies"].value("coalesce_max_wait_us", 50) * 1000ull;
+    std::string handler = j["strategies"].value("handler", "busy");
+    if (handler != "busy" && handler != "aggregate") throw std::runtime_error("Unknown strategies.handler: " + handler);
+    cfg.strategy_aggregates = handler == "aggregate";
+
+    if (j.contains("wait_strategies")) {
+        const auto& w = j["wait_strategies"];
+        cfg.wait.producer = parse_wait_kind(w.value("producer", "yield"));
+        cfg.wait.processor = parse_wait_kind(w.value("processor", "yield"));
+        cfg.wait.strategy = parse_wait_kind(w.value("strategy", "yield"));
+    }
+
+    cfg.clock = j.value("clock", "steady");
+    std::string origin = j.value("latency_origin", "send");
+    if (origin == "send") cfg.latency_origin = LatencyOrigin::Send;
+    else if (origin == "intended") cfg.latency_origin = LatencyOrigin::Intended;
+    else throw std::runtime_error("Unknown latency_origin: " + origin);
+    cfg.co_correction = j.value("co_correction", false);
+    cfg.metrics_jsonl = j.value("metrics_jsonl", false);
+    cfg.perf_counters = j.value("perf_counters", false);
+    cfg.routing_reload = j.value("routing_reload", false);
+    cfg.reload_fence_timeout_ns = j.value("reload_fence_timeout_ms", 100) * 1000000ull;
+    const json shm = j.value("shared_memory", json::object());
+    cfg.shm_name = shm.value("name", "");
+    if (!cfg.shm_name.empty() && cfg.shm_name[0] != '/') cfg.shm_name = "/" + cfg.shm_name;
+    cfg.shm_attach_timeout_ns = shm.value("attach_timeout_ms", 30000) * 1000000ull;
+
+    if (j.contains("placement")) {
+        const auto& pl = j["placement"];
+        auto cores = [&](const char* role) {
+            return pl.contains(role) ? pl[role].get<std::vector<int>>() : std::vector<int>{};
+        };
+        cfg.placement.producers = cores("producers");
+        cfg.placement.processors = cores("processors");
+        cfg.placement.strategies = cores("strategies");
+        cfg.placement.monitor = pl.value("monitor", -1);
+        std::string numa = pl.value("numa", "first_touch");
+        if (numa == "none") cfg.placement.numa = NumaPolicy::None;
+        else if (numa == "first_touch") cfg.placement.numa = NumaPolicy::FirstTouch;
+        else if (numa == "mbind") cfg.placement.numa = NumaPolicy::Bind;
+        else throw std::runtime_error("Unknown placement.numa: " + numa);
+    }
 
-    cfg.stage1_routing.resize(8, 0);
+    cfg.rate.messages_per_sec = j["producers"].value("messages_per_sec", 0.0);
+    cfg.rate.burst_multiplier = j.value("burst_multiplier", 1.0);
+    cfg.rate.quiet_multiplier = j.value("quiet_multiplier", 1.0);
+    cfg.rate.burst_ns = j.value("burst_duration_ms", 0) * 1000000ull;
+    cfg.rate.quiet_ns = j.value("quiet_duration_ms", 0) * 1000000ull;
+
+    cfg.type_weights.assign(MAX_MSG_TYPES, 0.0);
+    if (j["producers"].contains("distribution")) {
+        for (auto& [key, weight] : j["producers"]["distribution"].items()) {
+            int type = std::stoi(key.substr(key.find_last_of('_') + 1));
+            if (type < 0 || type >= MAX_MSG_TYPES)
+                throw std::runtime_error("Message type out of range in distribution: " + key);
+            if (!weight.is_number() || !std::isfinite(weight.get<double>()) || weight.get<double>() < 0)
+                throw std::runtime_error("producers.distribution." + key + " must be a finite weight >= 0");
+            cfg.type_weights[type] = weight;
+        }
+        if (std::none_of(cfg.type_weights.begin(), cfg.type_weights.end(), [](double w) { return w > 0; }))
+            throw std::runtime_error("producers.distribution has no positive weight");
+    } else {
+        std::fill_n(cfg.type_weights.begin(), 4, 1.0);
+    }
+    std::string source = j["producers"].value("type_source", "alias");
+    if (source == "alias") cfg.type_source = TypeSource::Alias;
+    else if (source == "tape") cfg.type_source = TypeSource::Tape;
+    else if (source == "trace") cfg.type_source = TypeSource::Trace;
+    else throw std::runtime_error("Unknown producers.type_source: " + source);
+    cfg.tape_length = std::bit_ceil(j["producers"].value("tape_length", (size_t)1 << 16));
+    cfg.trace_file = j["producers"].value("trace_file", "");
+    if (cfg.type_source == TypeSource::Trace && cfg.trace_file.empty())
+        throw std::runtime_error("producers.type_source trace needs producers.trace_file");
+    cfg.capture_trace = j.value("capture_trace", false);
+    cfg.capture_max_records = j.value("capture_max_records", (size_t)1 << 22);
+    if (cfg.capture_trace && cfg.capture_max_records == 0)
+        throw std::runtime_error("capture_max_records must be positive");
+
+    // "payload_bytes": N for a fixed size, or {"min": N, "max": M}.
+    cfg.payload_min_bytes = cfg.payload_max_bytes = 0;
+    if (j["producers"].contains("payload_bytes")) {
+        const auto& pb = j["producers"]["payload_bytes"];
+        if (pb.is_object()) {
+            cfg.payload_min_bytes = pb.value("min", (size_t)0);
+            cfg.payload_max_bytes = pb.value("max", cfg.payload_min_bytes);
+        } else {
+            cfg.payload_min_bytes = cfg.payload_max_bytes = pb.get<size_t>();
+        }
+        if (cfg.payload_min_bytes > cfg.payload_max_bytes)
+            throw std::runtime_error("producers.payload_bytes: min exceeds max");
+    }
+    cfg.payload_pool_slots = j["producers"].value("payload_pool_slots", (size_t)4096);
+    if (cfg.payload_max_bytes && cfg.payload_pool_slots == 0)
+        throw std::runtime_error("producers.payload_pool_slots must be positive");
+
+    // Keys look like "msg_type_3" / "strategy_1"; the suffix is the index.
+    auto read_costs = [](const json& section, const char* name, size_t n) {
+        std::vector<uint64_t> costs(n, 0);
+        if (!section.contains(name)) return costs;
+        for (auto& [key, ns] : section[name].items()) {
+            size_t idx = std::stoul(key.substr(key.find_last_of('_') + 1));
+            if (idx < n) costs[idx] = ns;
+        }
+        return costs;
+    };
+    cfg.processor_cost_ns = read_costs(j["processors"], "processing_times_ns", MAX_MSG_TYPES);
+    cfg.strategy_cost_ns = read_costs(j["strategies"], "processing_times_ns", cfg.strategy_count);
+    cfg.strategy_call_overhead_ns = read_costs(j["strategies"], "call_overhead_ns", cfg.strategy_count);
+
+    cfg.stage1_routing.resize(MAX_MSG_TYPES);
+    std::string default_policy = j.value("stage1_policy", "round_robin");
     for (auto& rule : j["stage1_rules"]) {
         int type = rule["msg_type"];
-        cfg.stage1_routing[type] = rule["processors"][0];
+        Stage1Route& route = cfg.stage1_routing[type];
+        route.processors = rule["processors"].get<std::vector<int>>();
+        route.policy = parse_balance_policy(rule.value("policy", default_policy));
+        if (route.processors.empty())
+            throw std::runtime_error("stage1 rule without processors for msg_type " + std::to_string(type));
+        for (int p : route.processors)
+            if (p < 0 || p >= cfg.processor_count)
+                throw std::runtime_error("stage1 rule references unknown processor " + std::to_string(p));
     }
 
-    cfg.stage2_routing.resize(8, 0);
+    cfg.stage2_routing.resize(MAX_MSG_TYPES, 0);
+    cfg.ordering_required.assign(MAX_MSG_TYPES, false);
     for (auto& rule : j["stage2_rules"]) {
         int type = rule["msg_type"];
         cfg.stage2_routing[type] = rule["strategy"];
+        cfg.ordering_required[type] = rule.value("ordering_required", false);
+    }
+
+    cfg.ordering_mode = parse_ordering_mode(j.value("ordering_mode", "affinity"));
+    cfg.reorder_window = std::bit_ceil(j.value("reorder_window", (size_t)1024));
+    cfg.reorder_max_hold_ns = j.value("reorder_max_hold_us", 1000) * 1000ull;
+    if (cfg.ordering_mode == OrderingMode::Affinity) {
+        for (int type = 0; type < MAX_MSG_TYPES; ++type)
+            if (cfg.ordering_required[type])
+                cfg.stage1_routing[type].policy = BalancePolicy::Sticky;
     }
 
     return cfg;
 }
 
+// ==========================================================
+// Routing Tables
+// ==========================================================
+// The pipeline reads its shape and routing through DynamicRouting or
+// StaticRouting (router/routing.hpp). What is left here checks reloads and
+// writes the StaticRouting header.
+// Why next cannot be applied to a running scenario loaded as cfg; empty if
+// it can. Only the stage-1 and stage-2 rules are taken from a reload, and a
+// stage-2 move would split an ordered type's key across strategies.
+static std::string reload_conflict(const Config& cfg, const Config& next) {
+    if (next.producer_count != cfg.producer_count || next.processor_count != cfg.processor_count ||
+        next.strategy_count != cfg.strategy_count)
+        return "thread counts";
+    if (next.stage1_ingress != cfg.stage1_ingress) return "stage1_ingress";
+    if (next.ordering_mode != cfg.ordering_mode || next.ordering_required != cfg.ordering_required)
+        return "ordering settings";
+    for (int type = 0; type < MAX_MSG_TYPES; ++type) {
+        if (next.stage2_routing[type] < 0 || next.stage2_routing[type] >= cfg.strategy_count)
+            return "stage2 rule for msg_type " + std::to_string(type) + " (unknown strategy)";
+        if (cfg.ordering_mode != OrderingMode::None && cfg.ordering_required[type] &&
+            next.stage2_routing[type] != cfg.stage2_routing[type])
+            return "stage2 rule for ordered msg_type " + std::to_string(type);
+    }
+    return "";
+}
+
+// Set by SIGHUP while a routing_reload scenario runs; its monitor polls it.
+static std::atomic<bool> reload_requested{false};
+extern "C" void request_reload(int) { reload_requested.store(true, std::memory_order_relaxed); }
+
+// Writes the StaticRouting header for cfg.
+static void emit_topology(const Config& cfg, const std::string& config_path, std::ostream& out) {
+    auto table = [&](auto&& value) {
+        std::string s = "{";
+        for (int type = 0; type < MAX_MSG_TYPES; ++type)
+            s += (type ? ", " : "") + value(type);
+        return s + "}";
+    };
+    auto str = [](auto v) { return std::to_string(v); };
+    const char* ingress = "Lanes";
+    switch (cfg.stage1_ingress) {
+        case IngressTopology::Shared: ingress = "Shared"; break;
+        case IngressTopology::Lanes: ingress = "Lanes"; break;
+        case IngressTopology::Mpsc: ingress = "Mpsc"; break;
+        case IngressTopology::ByteLanes: ingress = "ByteLanes"; break;
+    }
+    out << "// Generated by: router --emit-topology " << config_path << "\n"
+        << "// Build with -DROUTER_STATIC_TOPOLOGY='\"<this header>\"'.\n"
+        << "#pragma once\n\n"
+        << "struct GeneratedTopology {\n"
+        << "    static constexpr const char* source = \"" << config_path << "\";\n"
+        << "    static constexpr IngressTopology ingress = IngressTopology::" << ingress << ";\n"
+        << "    static constexpr int producer_count = " << cfg.producer_count << ";\n"
+        << "    static constexpr int processor_count = " << cfg.processor_count << ";\n"
+        << "    static constexpr int strategy_count = " << cfg.strategy_count << ";\n"
+        << "    static constexpr std::array<int, MAX_MSG_TYPES> fixed_processor = "
+        << table([&](int t) { return str(fixed_processor_of(cfg.stage1_routing[t])); }) << ";\n"
+        << "    static constexpr std::array<int, MAX_MSG_TYPES> stage2 = "
+        << table([&](int t) { return str(cfg.stage2_routing[t]); }) << ";\n"
+        << "    static constexpr std::array<bool, MAX_MSG_TYPES> ordered = "
+        << table([&](int t) { return std::string(cfg.ordering_required[t] ? "true" : "false"); }) << ";\n"
+        << "};\n";
+}
+
+#if defined(ROUTER_STATIC_TOPOLOGY)
+#include ROUTER_STATIC_TOPOLOGY
+#endif
+
 static inline uint64_t now_ns() {
     return std::chrono::duration_cast<std::chrono::nanoseconds>(
         std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-constexpr size_t QUEUE_SIZE = 1 << 14;
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
 
 // ==========================================================
-// Latency Statistics
+// TSC Calibration and Busy Work
 // ==========================================================
-struct LatencyStats {
-    std::mutex mtx;
-    std::vector<double> stage1_us;
-    std::vector<double> processing_us;
-    std::vector<double> stage2_us;
-    std::vector<double> total_us;
-
-    void add(double s1, double proc, double s2, double total) {
-        std::lock_guard<std::mutex> lock(mtx);
-        stage1_us.push_back(s1);
-        processing_us.push_back(proc);
-        stage2_us.push_back(s2);
-        total_us.push_back(total);
-    }
-
-    static double percentile(std::vector<double>& v, double p) {
-        if (v.empty()) return 0.0;
-        std::sort(v.begin(), v.end());
-        size_t idx = std::min((size_t)(p * v.size()), v.size() - 1);
-        return v[idx];
+static inline uint64_t read_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+// Waits for earlier instructions before reading, so a timestamp taken right
+// after a store to a queue is not hoisted above it.
+static inline uint64_t read_tscp() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned aux;
+    return __rdtscp(&aux);
+#else
+    return now_ns();
+#endif
+}
+
+struct TscCalibration {
+    double ticks_per_ns = 1.0;
+
+    uint64_t to_ticks(uint64_t ns) const { return (uint64_t)(ns * ticks_per_ns); }
+    uint64_t to_ns(uint64_t ticks) const { return (uint64_t)(ticks / ticks_per_ns); }
+};
+
+// Measures the TSC rate against steady_clock over a short window at startup.
+TscCalibration calibrate_tsc() {
+    TscCalibration cal;
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t t0 = now_ns(), c0 = read_tsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    uint64_t t1 = now_ns(), c1 = read_tsc();
+    if (t1 > t0 && c1 > c0) cal.ticks_per_ns = (double)(c1 - c0) / (t1 - t0);
+#endif
+    return cal;
+}
+
+// Calibrated on first use and shared by every scenario of the process.
+static const TscCalibration& process_tsc() {
+    static const TscCalibration cal = calibrate_tsc();
+    return cal;
+}
+
+// Timestamp source for the per-message hot path. The TSC sources are mapped
+// onto the steady_clock timeline through the startup calibration, so their
+// values compare directly with now_ns().
+enum class ClockSource { Steady, Tsc, Tscp };
+
+static ClockSource parse_clock_source(const std::string& name) {
+    if (name == "steady") return ClockSource::Steady;
+    if (name == "tsc") return ClockSource::Tsc;
+    if (name == "rdtscp") return ClockSource::Tscp;
+    throw std::runtime_error("Unknown clock: " + name);
+}
+
+static const char* clock_source_name(ClockSource source) {
+    switch (source) {
+        case ClockSource::Steady: return "steady";
+        case ClockSource::Tsc: return "tsc";
+        case ClockSource::Tscp: return "rdtscp";
+    }
+    return "?";
+}
+
+class Clock {
+public:
+    Clock(ClockSource source, const TscCalibration& cal)
+        : source_(source), ns_per_tick_(1.0 / cal.ticks_per_ns),
+          base_ns_(now_ns()), base_ticks_(read_tsc()) {}
+
+    uint64_t now() const {
+        switch (source_) {
+            case ClockSource::Tsc: return from_ticks(read_tsc());
+            case ClockSource::Tscp: return from_ticks(read_tscp());
+            default: return now_ns();
+        }
+    }
+
+    ClockSource source() const { return source_; }
+
+private:
+    uint64_t from_ticks(uint64_t ticks) const {
+        return base_ns_ + (uint64_t)(int64_t)((double)(int64_t)(ticks - base_ticks_) * ns_per_tick_);
     }
+
+    ClockSource source_;
+    double ns_per_tick_;
+    uint64_t base_ns_;
+    uint64_t base_ticks_;
 };
 
-int main(int argc, char** argv) {
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <config.json> <results_dir>\n";
-        return 1;
+// Simulated per-message cost: spins until the TSC has advanced by ticks.
+static inline void busy_work(uint64_t ticks) {
+    const uint64_t start = read_tsc();
+    while (read_tsc() - start < ticks) cpu_relax();
+}
+
+// ==========================================================
+// Wait Strategies
+// ==========================================================
+// A thread that parks sleeps on its own ParkingSpot. The side that makes
+// progress possible calls notify(), which costs a fence and one load unless
+// the sleeper is actually parked. Parking also times out so a missed or
+// unsent wakeup (e.g. an idle work-stealing peer) only costs kParkTimeoutNs.
+class ParkingSpot {
+public:
+    static constexpr long kParkTimeoutNs = 1000000;
+
+    template <typename Ready>
+    void park(Ready&& ready) {
+        uint32_t e = epoch_.load(std::memory_order_acquire);
+        parked_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready()) futex_wait(e);
+        parked_.store(false, std::memory_order_relaxed);
     }
 
-    std::string config_path = argv[1];
-    std::string results_dir = argv[2];
-    std::filesystem::create_directories(results_dir);
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        notify_if_parked();
+    }
 
-    std::string scenario = std::filesystem::path(config_path).stem().string();
-    std::string log_path = results_dir + "/" + scenario + "_log.txt";
-    std::string summary_path = results_dir + "/" + scenario + "_summary.txt";
-    std::ofstream log_file(log_path);
-    std::ofstream summary_file(summary_path);
+    // For callers that already issued the fence.
+    void notify_if_parked() {
+        if (parked_.load(std::memory_order_relaxed)) wake();
+    }
 
-    Config cfg = load_config(config_path);
-    std::cout << "Running scenario: " << scenario << std::endl;
+    void wake() {
+        epoch_.fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, INT32_MAX,
+                nullptr, nullptr, 0);
+#else
+        epoch_.notify_all();
+#endif
+    }
 
-    std::vector<std::unique_ptr<SPSCQueue<Message, QUEUE_SIZE>>> stage1_queues;
-    std::vector<std::unique_ptr<SPSCQueue<Message, QUEUE_SIZE>>> stage2_queues;
-    for (int i = 0; i < cfg.processor_count; ++i)
-        stage1_queues.push_back(std::make_unique<SPSCQueue<Message, QUEUE_SIZE>>());
-    for (int i = 0; i < cfg.strategy_count; ++i)
-        stage2_queues.push_back(std::make_unique<SPSCQueue<Message, QUEUE_SIZE>>());
+private:
+    void futex_wait(uint32_t expected) {
+#if defined(__linux__)
+        timespec timeout{0, kParkTimeoutNs};
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, expected,
+                &timeout, nullptr, 0);
+#else
+        epoch_.wait(expected, std::memory_order_acquire);
+#endif
+    }
 
-    std::atomic<bool> stop_flag = false;
-    std::atomic<uint64_t> produced = 0, processed = 0, delivered = 0;
-    LatencyStats latencies;
+    alignas(64) std::atomic<uint32_t> epoch_{0};
+    std::atomic<bool> parked_{false};
+};
 
-    // ==========================================================
-    // Producers
-    // ==========================================================
-    std::vector<std::thread> producers;
-    for (int pid = 0; pid < cfg.producer_count; ++pid) {
-        producers.emplace_back([&, pid]() {
-            uint32_t seq = 0;
-            std::mt19937 gen(pid + 1);
-            std::uniform_int_distribution<int> type_dist(0, 3);
-            while (!stop_flag.load(std::memory_order_relaxed)) {
-                Message msg;
-                msg.msg_type = type_dist(gen);
-                msg.producer_id = pid;
-                msg.sequence = seq++;
-                msg.timestamp_ns = now_ns();
+// Wakes whichever of spots are parked, with a single fence for the batch.
+static void notify_parked(std::vector<ParkingSpot>& spots) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (auto& spot : spots) spot.notify_if_parked();
+}
 
-                int proc_id = cfg.stage1_routing[msg.msg_type];
-                auto& q = *stage1_queues[proc_id];
-                if (q.push(msg)) {
-                    produced++;
-                } else {
-                    std::this_thread::yield();
-                }
-            }
-        });
+// Per-loop wait state. idle() is called after each failed attempt and
+// escalates with the number of consecutive failures; reset() after progress.
+class Waiter {
+public:
+    static constexpr uint32_t kSpinLimit = 64;
+    static constexpr uint32_t kYieldLimit = kSpinLimit + 64;
+
+    Waiter(WaitKind kind, ParkingSpot& spot) : kind_(kind), spot_(spot) {}
+
+    template <typename Ready>
+    void idle(Ready&& ready) {
+        uint32_t n = failures_++;
+        if (kind_ == WaitKind::Spin) {
+            cpu_relax();
+        } else if (n < kSpinLimit) {
+            for (uint32_t i = 0, pauses = 1u << std::min(n / 8, 6u); i < pauses; ++i)
+                cpu_relax();
+        } else if (kind_ == WaitKind::Yield || n < kYieldLimit) {
+            std::this_thread::yield();
+        } else {
+            spot_.park(ready);
+        }
     }
 
-    // ==========================================================
-    // Processors
-    // ==========================================================
-    std::vector<std::thread> processors;
-    for (int proc_id = 0; proc_id < cfg.processor_count; ++proc_id) {
-        processors.emplace_back([&, proc_id]() {
-            Message msg;
-            while (!stop_flag.load(std::memory_order_relaxed)) {
-                if (stage1_queues[proc_id]->pop(msg)) {
-                    uint64_t t_now = now_ns();
-                    double stage1_us = (t_now - msg.timestamp_ns) / 1000.0;
-                    msg.processor_id = proc_id;
-                    msg.processed_ns = t_now;
-                    double processing_us = 0.0; // negligible in this simple demo
+    void reset() { failures_ = 0; }
 
-                    int strat_id = cfg.stage2_routing[msg.msg_type];
-                    while (!stage2_queues[strat_id]->push(msg)) {
-                        if (stop_flag.load()) return;
-                        std::this_thread::yield();
-                    }
-                    processed++;
-                } else {
-                    std::this_thread::yield();
-                }
+private:
+    WaitKind kind_;
+    ParkingSpot& spot_;
+    uint32_t failures_ = 0;
+};
+
+// ==========================================================
+// Thread and Memory Placement
+// ==========================================================
+static bool pin_current_thread(int cpu) {
+    if (cpu < 0) return true;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// NUMA node of a CPU from sysfs; 0 when unknown.
+static int numa_node_of_cpu(int cpu) {
+    if (cpu < 0) return 0;
+    std::error_code ec;
+    std::filesystem::path dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    for (auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("node", 0) == 0 && name.size() > 4 && std::isdigit((unsigned char)name[4]))
+            return std::stoi(name.substr(4));
+    }
+    return 0;
+}
+
+// Binds the whole pages inside region to node (MPOL_BIND, moving pages that
+// are already resident). Uses the raw syscall so libnuma is not required.
+static bool bind_to_node(const MemoryRegion& region, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    constexpr int kMpolBind = 2;
+    constexpr unsigned kMpolMfMove = 1u << 1;
+    const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)region.data + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)region.data + region.bytes) & ~(page - 1);
+    if (end <= begin) return true;
+    unsigned long mask[4] = {};
+    if (node < 0 || node >= (int)(sizeof(mask) * 8)) return false;
+    mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+    return syscall(SYS_mbind, begin, end - begin, kMpolBind, mask, sizeof(mask) * 8, kMpolMfMove) == 0;
+#else
+    (void)region;
+    (void)node;
+    return false;
+#endif
+}
+
+// Write-faults every page of region from the calling thread, keeping its
+// contents. A plain read first would map the shared zero page, and a later
+// write to a huge zero page falls back to base pages.
+static void prefault(const MemoryRegion& region) {
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* p = static_cast<char*>(region.data);
+    for (size_t off = 0; off < region.bytes; off += page)
+        std::atomic_ref<char>(p[off]).fetch_or(0, std::memory_order_relaxed);
+}
+
+// ==========================================================
+// Worker Pool
+// ==========================================================
+// Threads kept for the whole process, so a batch of scenarios does not
+// respawn its pipeline threads. Worker i runs one task at a time; the mutex
+// is only taken to hand a task over and to collect it. Each task starts with
+// the affinity the process had at startup, whatever pinning the previous
+// scenario's task left behind.
+static uint64_t thread_cpu_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+class WorkerPool {
+public:
+    WorkerPool() {
+#if defined(__linux__)
+        CPU_ZERO(&startup_affinity_);
+        has_affinity_ = sched_getaffinity(0, sizeof(startup_affinity_), &startup_affinity_) == 0;
+#endif
+    }
+
+    ~WorkerPool() {
+        for (auto& w : workers_) {
+            {
+                std::lock_guard<std::mutex> lock(w->mutex);
+                w->quit = true;
             }
-        });
+            w->cv.notify_all();
+            w->thread.join();
+        }
     }
 
-    // ==========================================================
-    // Strategies
-    // ==========================================================
-    std::vector<std::thread> strategies;
-    for (int sid = 0; sid < cfg.strategy_count; ++sid) {
-        strategies.emplace_back([&, sid]() {
-            Message msg;
-            while (!stop_flag.load(std::memory_order_relaxed)) {
-                if (stage2_queues[sid]->pop(msg)) {
-                    uint64_t t_end = now_ns();
-                    double stage2_us = (t_end - msg.processed_ns) / 1000.0;
-                    double stage1_us = (msg.processed_ns - msg.timestamp_ns) / 1000.0;
-                    double processing_us = stage2_us; // simple proxy
-                    double total_us = (t_end - msg.timestamp_ns) / 1000.0;
-
-                    latencies.add(stage1_us, processing_us, stage2_us, total_us);
-                    delivered++;
-                } else {
-                    std::this_thread::yield();
-                }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Hands task to worker i, spawning workers up to i on first use.
+    void run(size_t i, std::function<void()> task) {
+        while (workers_.size() <= i) {
+            workers_.push_back(std::make_unique<Worker>());
+            Worker& w = *workers_.back();
+            w.thread = std::thread([this, &w] { loop(w); });
+        }
+        Worker& w = *workers_[i];
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.task = std::move(task);
+            w.busy = true;
+        }
+        w.cv.notify_all();
+    }
+
+    // Waits for worker i's task and returns the thread CPU time it used.
+    uint64_t wait(size_t i) {
+        Worker& w = *workers_[i];
+        std::unique_lock<std::mutex> lock(w.mutex);
+        w.cv.wait(lock, [&] { return !w.busy; });
+        return w.cpu_ns;
+    }
+
+    void restore_affinity() const {
+#if defined(__linux__)
+        if (has_affinity_) pthread_setaffinity_np(pthread_self(), sizeof(startup_affinity_), &startup_affinity_);
+#endif
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::function<void()> task;
+        bool busy = false;
+        bool quit = false;
+        uint64_t cpu_ns = 0;
+        std::thread thread;
+    };
+
+    void loop(Worker& w) {
+        std::unique_lock<std::mutex> lock(w.mutex);
+        for (;;) {
+            w.cv.wait(lock, [&] { return w.quit || w.task; });
+            if (!w.task) return;
+            std::function<void()> task = std::move(w.task);
+            w.task = nullptr;
+            lock.unlock();
+            restore_affinity();
+            const uint64_t cpu0 = thread_cpu_ns();
+            task();
+            const uint64_t used = thread_cpu_ns() - cpu0;
+            lock.lock();
+            w.cpu_ns = used;
+            w.busy = false;
+            w.cv.notify_all();
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+#if defined(__linux__)
+    cpu_set_t startup_affinity_;
+#endif
+    bool has_affinity_ = false;
+};
+
+// ==========================================================
+// Message Type Sampling
+// ==========================================================
+// xoshiro256** seeded through splitmix64: a few cycles per draw, no state
+// beyond four words.
+class Xoshiro256 {
+public:
+    explicit Xoshiro256(uint64_t seed) {
+        for (auto& word : s_) {
+            seed += 0x9e3779b97f4a7c15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t operator()() {
+        const uint64_t result = std::rotl(s_[1] * 5, 7) * 9;
+        const uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = std::rotl(s_[3], 45);
+        return result;
+    }
+
+private:
+    std::array<uint64_t, 4> s_;
+};
+
+// Walker/Vose alias table: one random word picks a column (high half) and
+// flips its biased coin (low half), so sampling is O(1) with no branches on
+// the distribution shape.
+class AliasTable {
+public:
+    explicit AliasTable(const std::vector<double>& weights) {
+        const size_t n = weights.size();
+        double sum = 0.0;
+        for (double w : weights) sum += std::max(w, 0.0);
+        if (n == 0 || sum <= 0.0)
+            throw std::runtime_error("Message type distribution has no positive weight");
+
+        threshold_.assign(n, UINT32_MAX);
+        alias_.resize(n);
+        std::vector<double> scaled(n);
+        std::vector<size_t> small, large;
+        for (size_t i = 0; i < n; ++i) {
+            alias_[i] = (uint8_t)i;
+            scaled[i] = std::max(weights[i], 0.0) * n / sum;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            size_t s = small.back(), l = large.back();
+            small.pop_back();
+            threshold_[s] = (uint32_t)(scaled[s] * 4294967295.0);
+            alias_[s] = (uint8_t)l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
             }
-        });
+        }
+        // Leftovers are 1.0 up to rounding error and keep their own column.
     }
 
-    // ==========================================================
-    // Monitoring loop
-    // ==========================================================
-    auto start = std::chrono::steady_clock::now();
-    uint64_t prev_prod = 0, prev_proc = 0, prev_del = 0;
+    uint8_t sample(uint64_t r) const {
+        size_t col = (size_t)(((r >> 32) * threshold_.size()) >> 32);
+        return (uint32_t)r < threshold_[col] ? (uint8_t)col : alias_[col];
+    }
 
-    for (int sec = 1; sec <= cfg.duration_secs; ++sec) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        uint64_t p = produced.load(), r = processed.load(), d = delivered.load();
+private:
+    std::vector<uint32_t> threshold_;
+    std::vector<uint8_t> alias_;
+};
+
+// ==========================================================
+// Producer Pacing
+// ==========================================================
+// Deadline schedule: each message has an intended send time and the producer
+// spins on the clock until it is reached, so there is no sleep_for
+// granularity in the inter-arrival gaps. A producer that falls behind (e.g.
+// blocked on a full queue) catches up at most max_lag_ns worth of messages,
+// like a token bucket of that depth; with kNoLagLimit no slot is ever skipped
+// and it sends back-to-back until caught up. With sleep_long_gaps (producers
+// set to park) gaps longer than kSleepThresholdNs are mostly slept through
+// and only the final kSpinMarginNs is spun.
+class Pacer {
+public:
+    static constexpr uint64_t kMaxLagNs = 1000000;
+    static constexpr uint64_t kNoLagLimit = UINT64_MAX;
+    static constexpr uint64_t kSleepThresholdNs = 200000;
+    static constexpr uint64_t kSpinMarginNs = 100000;
 
-        double produced_m = (p - prev_prod) / 1e6;
-        double processed_m = (r - prev_proc) / 1e6;
-        double delivered_m = (d - prev_del) / 1e6;
+    Pacer(const RateProfile& profile, const Clock& clock, uint64_t start_ns, bool sleep_long_gaps = false,
+          uint64_t max_lag_ns = kMaxLagNs)
+        : profile_(profile), clock_(clock), start_ns_(start_ns), next_ns_(start_ns),
+          max_lag_ns_(max_lag_ns), sleep_long_gaps_(sleep_long_gaps) {}
 
-        uint64_t lost_now = (p - d) - (prev_prod - prev_del);
-        double lost_m = lost_now / 1e6;
+    // Waits for the next slot and returns its intended send time.
+    uint64_t wait_next() {
+        if (!profile_.paced()) return clock_.now();
+        uint64_t due = wait_until(next_ns_);
+        double rate = profile_.rate_at(due - start_ns_);
+        next_ns_ = due + (rate > 0.0 ? (uint64_t)(1e9 / rate) : kMaxLagNs);
+        return due;
+    }
 
-        prev_prod = p;
-        prev_proc = r;
-        prev_del = d;
+    // Trace replay: the next slot is gap_ns after the previous one (the
+    // first, after start_ns), whatever the rate profile says.
+    uint64_t wait_gap(uint64_t gap_ns) {
+        next_ns_ = wait_until(next_ns_ + gap_ns);
+        return next_ns_;
+    }
 
-        // Queue sizes
-        std::ostringstream s1, s2;
-        s1 << "[";
-        for (size_t i = 0; i < stage1_queues.size(); ++i) {
-            s1 << stage1_queues[i]->size();
-            if (i + 1 < stage1_queues.size()) s1 << ", ";
+private:
+    uint64_t wait_until(uint64_t due) {
+        uint64_t now = clock_.now();
+        if (sleep_long_gaps_ && now + kSleepThresholdNs < due) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - kSpinMarginNs));
+            now = clock_.now();
         }
-        s1 << "]";
-        s2 << "[";
-        for (size_t i = 0; i < stage2_queues.size(); ++i) {
-            s2 << stage2_queues[i]->size();
-            if (i + 1 < stage2_queues.size()) s2 << ", ";
+        while (now < due) {
+            cpu_relax();
+            now = clock_.now();
         }
-        s2 << "]";
+        if (now - due > max_lag_ns_) due = now - max_lag_ns_;
+        return due;
+    }
 
-        std::ostringstream line;
-        line << "[" << std::fixed << std::setprecision(2) << (double)sec
-             << "s] Produced: " << produced_m << "M | "
-             << "Processed: " << processed_m << "M | "
-             << "Delivered: " << delivered_m << "M | "
-             << "Lost: " << lost_m << "M | "
-             << "Stage1 Queues: " << s1.str()
-             << " | Stage2 Queues: " << s2.str();
+    RateProfile profile_;
+    const Clock& clock_;
+    uint64_t start_ns_;
+    uint64_t next_ns_;
+    uint64_t max_lag_ns_;
+    bool sleep_long_gaps_;
+};
 
-        std::cout << line.str() << std::endl;
-        log_file << line.str() << "\n";
+// ==========================================================
+// Burst Recovery Tracking
+// ==========================================================
+// Fed by the monitor with the total queue depth on every tick. A burst has
+// recovered once depth falls back to where it was before the burst started
+// (plus one drain batch per consumer of slack).
+class BurstRecoveryTracker {
+public:
+    BurstRecoveryTracker(const RateProfile& profile, uint64_t slack)
+        : profile_(profile), slack_(slack) {}
+
+    void sample(uint64_t elapsed_ns, uint64_t depth) {
+        if (!profile_.bursty()) return;
+        bool burst = profile_.in_burst(elapsed_ns);
+        if (burst && !in_burst_) {
+            if (awaiting_recovery_) ++unrecovered_;
+            awaiting_recovery_ = false;
+            baseline_ = last_depth_;
+            peak_ = depth;
+            ++cycles_;
+        } else if (!burst && in_burst_) {
+            burst_end_ns_ = elapsed_ns;
+            awaiting_recovery_ = true;
+            peak_depths_.push_back(peak_);
+        }
+        if (burst) peak_ = std::max(peak_, depth);
+        if (awaiting_recovery_ && depth <= baseline_ + slack_) {
+            recovery_ns_.push_back(elapsed_ns - burst_end_ns_);
+            awaiting_recovery_ = false;
+        }
+        in_burst_ = burst;
+        last_depth_ = depth;
     }
 
-    stop_flag = true;
+    void write_summary(std::ostream& out) const {
+        if (!profile_.bursty()) return;
+        auto avg_max = [](const std::vector<uint64_t>& v) {
+            uint64_t sum = 0, mx = 0;
+            for (auto x : v) { sum += x; mx = std::max(mx, x); }
+            return std::pair<double, uint64_t>(v.empty() ? 0.0 : (double)sum / v.size(), mx);
+        };
+        auto [peak_avg, peak_max] = avg_max(peak_depths_);
+        auto [rec_avg, rec_max] = avg_max(recovery_ns_);
+        out << "\nBurst Recovery:\n";
+        out << "Bursts: " << cycles_ << " | Recovered: " << recovery_ns_.size()
+            << " | Unrecovered: " << unrecovered_ + (awaiting_recovery_ ? 1 : 0) << "\n";
+        out << "Peak queue depth  avg " << peak_avg << "  max " << peak_max << "\n";
+        out << "Recovery (ms)     avg " << rec_avg / 1e6 << "  max " << rec_max / 1e6 << "\n";
+    }
 
-    for (auto& t : producers) t.join();
-    for (auto& t : processors) t.join();
-    for (auto& t : strategies) t.join();
+private:
+    RateProfile profile_;
+    uint64_t slack_;
+    bool in_burst_ = false;
+    bool awaiting_recovery_ = false;
+    uint64_t last_depth_ = 0;
+    uint64_t baseline_ = 0;
+    uint64_t peak_ = 0;
+    uint64_t burst_end_ns_ = 0;
+    uint64_t cycles_ = 0;
+    uint64_t unrecovered_ = 0;
+    std::vector<uint64_t> peak_depths_;
+    std::vector<uint64_t> recovery_ns_;
+};
 
-    // ==========================================================
-    // Summary
-    // ==========================================================
-    summary_file << "=== PERFORMANCE SUMMARY ===\n";
-    summary_file << "Scenario: " << scenario << "\n";
-    summary_file << "Duration: " << cfg.duration_secs << " seconds\n";
-    summary_file << "Produced:  " << produced << "\n";
-    summary_file << "Processed: " << processed << "\n";
-    summary_file << "Delivered: " << delivered << "\n";
-
-    summary_file << "\nLatency Percentiles (μs):\n";
-    summary_file << "Stage      p50    p90    p99\n";
-
-    summary_file << "Stage1   "
-                 << LatencyStats::percentile(latencies.stage1_us, 0.50) << "  "
-                 << LatencyStats::percentile(latencies.stage1_us, 0.90) << "  "
-                 << LatencyStats::percentile(latencies.stage1_us, 0.99) << "\n";
-
-    summary_file << "Process  "
-                 << LatencyStats::percentile(latencies.processing_us, 0.50) << "  "
-                 << LatencyStats::percentile(latencies.processing_us, 0.90) << "  "
-                 << LatencyStats::percentile(latencies.processing_us, 0.99) << "\n";
-
-    summary_file << "Stage2   "
-                 << LatencyStats::percentile(latencies.stage2_us, 0.50) << "  "
-                 << LatencyStats::percentile(latencies.stage2_us, 0.90) << "  "
-                 << LatencyStats::percentile(latencies.stage2_us, 0.99) << "\n";
-
-    summary_file << "Total    "
-                 << LatencyStats::percentile(latencies.total_us, 0.50) << "  "
-                 << LatencyStats::percentile(latencies.total_us, 0.90) << "  "
-                 << LatencyStats::percentile(latencies.total_us, 0.99) << "\n";
+// ==========================================================
+// Live Metrics
+// ==========================================================
+// Hot-path counters, one cache line per thread. Only the owner writes them,
+// with a relaxed load and store instead of a locked RMW; the monitor sums
+// the lines once per interval.
+struct alignas(64) ThreadCounters {
+    std::atomic<uint64_t> messages{0};    // produced / processed / delivered
+    std::atomic<uint64_t> full_waits{0};  // idle() calls on a full queue or an exhausted pool
+    std::atomic<uint64_t> empty_waits{0}; // idle() calls with nothing to consume
+    std::atomic<uint64_t> stall_ns{0};    // time blocked on backpressure
+    std::atomic<uint64_t> pool_waits{0};  // the subset of full_waits spent on the payload pool
+    std::atomic<uint64_t> epoch{0};       // routing table in use (producers, processors)
 
-    std::cout << "Scenario " << scenario << " complete. Results written to "
-              << summary_path << std::endl;
+    static void add(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
 
-    return 0;
+struct CounterTotals {
+    uint64_t messages = 0;
+    uint64_t full_waits = 0;
+    uint64_t empty_waits = 0;
+    uint64_t stall_ns = 0;
+    uint64_t pool_waits = 0;
+
+    static CounterTotals sum(const std::vector<ThreadCounters>& threads) {
+        CounterTotals t;
+        for (auto& c : threads) {
+            t.messages += c.messages.load(std::memory_order_relaxed);
+            t.full_waits += c.full_waits.load(std::memory_order_relaxed);
+            t.empty_waits += c.empty_waits.load(std::memory_order_relaxed);
+            t.stall_ns += c.stall_ns.load(std::memory_order_relaxed);
+            t.pool_waits += c.pool_waits.load(std::memory_order_relaxed);
+        }
+        return t;
+    }
+
+    CounterTotals operator-(const CounterTotals& prev) const {
+        return {messages - prev.messages, full_waits - prev.full_waits, empty_waits - prev.empty_waits,
+                stall_ns - prev.stall_ns, pool_waits - prev.pool_waits};
+    }
+};
+
+// Per-queue drop counts. Each dropping thread owns a padded row of cells and
+// writes them like ThreadCounters; totals are summed over rows on read.
+class DropCounters {
+public:
+    DropCounters(size_t threads, size_t queues)
+        : queues_(queues), lines_per_row_((queues + kCellsPerLine - 1) / kCellsPerLine),
+          lines_(threads * lines_per_row_) {}
+
+    void add(size_t thread, size_t queue, uint64_t n) {
+        ThreadCounters::add(cell(thread, queue), n);
+    }
+
+    std::vector<uint64_t> per_queue() const {
+        std::vector<uint64_t> totals(queues_, 0);
+        for (size_t line = 0; line < lines_.size(); ++line)
+            for (size_t i = 0; i < kCellsPerLine; ++i) {
+                size_t q = (line % lines_per_row_) * kCellsPerLine + i;
+                if (q < queues_) totals[q] += lines_[line].cells[i].load(std::memory_order_relaxed);
+            }
+        return totals;
+    }
+
+    uint64_t total() const {
+        uint64_t sum = 0;
+        for (uint64_t n : per_queue()) sum += n;
+        return sum;
+    }
+
+private:
+    static constexpr size_t kCellsPerLine = 64 / sizeof(uint64_t);
+    struct alignas(64) Line {
+        std::array<std::atomic<uint64_t>, kCellsPerLine> cells{};
+    };
+
+    std::atomic<uint64_t>& cell(size_t thread, size_t queue) {
+        return lines_[thread * lines_per_row_ + queue / kCellsPerLine].cells[queue % kCellsPerLine];
+    }
+
+    size_t queues_;
+    size_t lines_per_row_;
+    std::vector<Line> lines_;
+};
+
+// Times backpressure episodes: blocked() after every failed attempt counts
+// the wait and starts the clock on the first one, resumed() once through.
+class StallTimer {
+public:
+    StallTimer(const Clock& clock, ThreadCounters& counters) : clock_(clock), counters_(counters) {}
+
+    void blocked() {
+        ThreadCounters::add(counters_.full_waits, 1);
+        if (since_ == 0) since_ = clock_.now();
+    }
+
+    void resumed() {
+        if (since_ == 0) return;
+        ThreadCounters::add(counters_.stall_ns, clock_.now() - since_);
+        since_ = 0;
+    }
+
+private:
+    const Clock& clock_;
+    ThreadCounters& counters_;
+    uint64_t since_ = 0;
+};
+
+// Deepest depth the monitor has sampled on each queue, per interval and
+// over the whole run.
+class DepthHighWater {
+public:
+    explicit DepthHighWater(size_t queues) : interval_(queues, 0), run_(queues, 0) {}
+
+    void sample(size_t queue, uint64_t depth) {
+        interval_[queue] = std::max(interval_[queue], depth);
+        run_[queue] = std::max(run_[queue], depth);
+    }
+
+    // The current interval's marks; the next sample starts a new interval.
+    std::vector<uint64_t> roll() {
+        std::vector<uint64_t> marks(interval_.size(), 0);
+        marks.swap(interval_);
+        return marks;
+    }
+
+    const std::vector<uint64_t>& run() const { return run_; }
+
+    void reset_run() { std::fill(run_.begin(), run_.end(), 0); }
+
+private:
+    std::vector<uint64_t> interval_;
+    std::vector<uint64_t> run_;
+};
+
+// ==========================================================
+// Stage-1 Load Balancing
+// ==========================================================
+// One per producer thread; picks the destination processor for each message
+// from the candidates of its type, using queue depth where the policy asks.
+// Ingress is whatever reports per-processor depth: Stage1Ingress in process,
+// ShmStage1 across processes.
+template <typename Ingress>
+class Stage1Balancer {
+public:
+    Stage1Balancer(const std::vector<Stage1Route>& routes, const Ingress& ingress, int producer_id)
+        : routes_(&routes), ingress_(ingress), rng_(0x5eed0000u + producer_id),
+          sticky_hash_(Xoshiro256(producer_id)()) {}
+
+    const std::vector<Stage1Route>& routes() const { return *routes_; }
+    void set_routes(const std::vector<Stage1Route>& routes) { routes_ = &routes; }
+
+    int pick(uint8_t msg_type) {
+        const Stage1Route& route = (*routes_)[msg_type];
+        const auto& procs = route.processors;
+        const size_t n = procs.size();
+        if (n == 1) return procs[0];
+
+        switch (route.policy) {
+            case BalancePolicy::RoundRobin:
+                return procs[rr_[msg_type]++ % n];
+            case BalancePolicy::LeastLoaded: {
+                int best = procs[0];
+                size_t best_depth = ingress_.size(best);
+                for (size_t i = 1; i < n && best_depth > 0; ++i) {
+                    size_t depth = ingress_.size(procs[i]);
+                    if (depth < best_depth) {
+                        best = procs[i];
+                        best_depth = depth;
+                    }
+                }
+                return best;
+            }
+            case BalancePolicy::PowerOfTwo: {
+                uint64_t r = rng_();
+                size_t a = (size_t)(((r >> 32) * n) >> 32);
+                size_t b = (size_t)(((r & 0xffffffffu) * (n - 1)) >> 32);
+                if (b >= a) ++b;
+                return ingress_.size(procs[a]) <= ingress_.size(procs[b]) ? procs[a] : procs[b];
+            }
+            case BalancePolicy::Sticky:
+                return procs[sticky_hash_ % n];
+        }
+        return procs[0];
+    }
+
+private:
+    const std::vector<Stage1Route>* routes_;
+    const Ingress& ingress_;
+    Xoshiro256 rng_;
+    uint64_t sticky_hash_;
+    std::array<uint32_t, MAX_MSG_TYPES> rr_{};
+};
+
+// ==========================================================
+// Ordering: Reorder Buffer and Out-of-Order Detector
+// ==========================================================
+// Sequences are per (producer_id, msg_type) key and compared with wrapping
+// 32-bit arithmetic.
+static inline size_t order_key(const Message& msg) {
+    return (size_t)msg.producer_id * MAX_MSG_TYPES + msg.msg_type;
+}
+
+static inline int32_t seq_diff(uint32_t a, uint32_t b) { return (int32_t)(a - b); }
+
+// Counts deliveries whose sequence is not newer than the last one delivered
+// for the same key. Gaps are allowed.
+class OrderChecker {
+public:
+    explicit OrderChecker(int producer_count)
+        : next_(producer_count * MAX_MSG_TYPES, 0) {}
+
+    void check(const Message& msg) {
+        uint32_t& next = next_[order_key(msg)];
+        if (seq_diff(msg.sequence, next) < 0) ++violations_;
+        else next = msg.sequence + 1;
+    }
+
+    uint64_t violations() const { return violations_; }
+
+private:
+    std::vector<uint32_t> next_;
+    uint64_t violations_ = 0;
+};
+
+// Strategy-side reorder buffer. Each ordered key owns a window of slots
+// indexed by sequence; a message ahead of the expected sequence waits in its
+// slot until the gap fills, the window overflows, or the gap has been open
+// longer than max_hold_ns, at which point the missing sequences are skipped.
+// All memory is allocated up front.
+class ReorderBuffer {
+public:
+    ReorderBuffer(int producer_count, const std::vector<bool>& ordered_types,
+                  size_t window, uint64_t max_hold_ns)
+        : window_(window), mask_(window - 1), max_hold_ns_(max_hold_ns),
+          keys_(producer_count * MAX_MSG_TYPES) {
+        for (int pid = 0; pid < producer_count; ++pid) {
+            for (int type = 0; type < MAX_MSG_TYPES; ++type) {
+                if (!ordered_types[type]) continue;
+                size_t k = (size_t)pid * MAX_MSG_TYPES + type;
+                keys_[k].slots.resize(window_);
+                keys_[k].present.assign(window_, false);
+                active_.push_back(k);
+            }
+        }
+    }
+
+    template <typename Deliver>
+    void accept(const Message& msg, uint64_t now, Deliver&& deliver) {
+        Key& key = keys_[order_key(msg)];
+        if (key.slots.empty()) {
+            deliver(msg);
+            return;
+        }
+        int32_t ahead = seq_diff(msg.sequence, key.next);
+        if (ahead < 0) {
+            ++late_; // its gap was already skipped
+            deliver(msg);
+            return;
+        }
+        if (ahead == 0) {
+            deliver(msg);
+            ++key.next;
+            drain(key, deliver);
+            key.blocked_since = now; // whatever is still buffered waits on a new gap
+            return;
+        }
+        ++reordered_;
+        const uint32_t from = key.next;
+        if ((size_t)ahead >= window_) note_hold(key, now);
+        while ((size_t)seq_diff(msg.sequence, key.next) >= window_)
+            skip_one(key, deliver);
+        size_t slot = msg.sequence & mask_;
+        key.slots[slot] = msg;
+        key.present[slot] = true;
+        ++buffered_total_;
+        if (key.buffered++ == 0) key.blocked_since = now;
+        drain(key, deliver);
+        // Only a gap that moved restarts the hold timer; another arrival
+        // behind the same gap does not.
+        if (key.next != from) key.blocked_since = now;
+    }
+
+    // Releases keys whose gap has been open longer than max_hold_ns.
+    template <typename Deliver>
+    void expire(uint64_t now, Deliver&& deliver) {
+        for (size_t k : active_) {
+            Key& key = keys_[k];
+            if (key.buffered == 0 || now - key.blocked_since < max_hold_ns_) continue;
+            note_hold(key, now);
+            while (!key.present[key.next & mask_]) {
+                skip_one(key, deliver);
+                ++expired_;
+            }
+            drain(key, deliver);
+            key.blocked_since = now;
+        }
+    }
+
+    // Whether any key is waiting on a gap (so expire() still has work).
+    bool holding() const { return buffered_total_ > 0; }
+
+    uint64_t reordered() const { return reordered_; }
+    uint64_t skipped() const { return skipped_; }
+    uint64_t expired() const { return expired_; } // the skips max_hold_ns forced
+    // Longest a gap was held before being skipped. Well past max_hold_ns
+    // means expiry did not run (or did not fire) and only overflow cleared it.
+    uint64_t longest_hold_ns() const { return longest_hold_ns_; }
+    uint64_t late() const { return late_; }
+
+private:
+    struct Key {
+        uint32_t next = 0;
+        size_t buffered = 0;
+        uint64_t blocked_since = 0;
+        std::vector<Message> slots;
+        std::vector<bool> present;
+    };
+
+    template <typename Deliver>
+    void skip_one(Key& key, Deliver&& deliver) {
+        size_t slot = key.next & mask_;
+        if (key.present[slot]) {
+            key.present[slot] = false;
+            --key.buffered;
+            --buffered_total_;
+            deliver(key.slots[slot]);
+        } else {
+            ++skipped_;
+        }
+        ++key.next;
+    }
+
+    void note_hold(const Key& key, uint64_t now) {
+        if (key.buffered) longest_hold_ns_ = std::max(longest_hold_ns_, now - key.blocked_since);
+    }
+
+    template <typename Deliver>
+    void drain(Key& key, Deliver&& deliver) {
+        while (key.buffered > 0 && key.present[key.next & mask_]) {
+            size_t slot = key.next & mask_;
+            key.present[slot] = false;
+            --key.buffered;
+            --buffered_total_;
+            ++key.next;
+            deliver(key.slots[slot]);
+        }
+    }
+
+    size_t window_;
+    size_t mask_;
+    uint64_t max_hold_ns_;
+    std::vector<Key> keys_;
+    std::vector<size_t> active_;
+    size_t buffered_total_ = 0;
+    uint64_t reordered_ = 0;
+    uint64_t skipped_ = 0;
+    uint64_t expired_ = 0;
+    uint64_t longest_hold_ns_ = 0;
+    uint64_t late_ = 0;
+};
+
+// ==========================================================
+// Stage Latencies
+// ==========================================================
+// One set per strategy thread, so the delivery path never shares a line.
+struct alignas(64) StageLatencies {
+    LatencyHistogram stage1;
+    LatencyHistogram processing;
+    LatencyHistogram stage2;
+    LatencyHistogram strategy;
+    LatencyHistogram total;
+    LatencyHistogram stolen_total; // total latency of MSG_STOLEN messages
+
+    void merge(const StageLatencies& other) {
+        stolen_total.merge(other.stolen_total);
+        stage1.merge(other.stage1);
+        processing.merge(other.processing);
+        stage2.merge(other.stage2);
+        strategy.merge(other.strategy);
+        total.merge(other.total);
+    }
+
+    void reset() {
+        for (auto* h : {&stage1, &processing, &stage2, &strategy, &total, &stolen_total}) h->reset();
+    }
+};
+
+// The summary's percentile table and its results.json counterpart, in us.
+// Both the in-process and the --role summaries write them.
+static void write_percentile_row(std::ostream& out, const char* name, const LatencyHistogram& h) {
+    out << name;
+    for (double p : {0.50, 0.90, 0.99, 0.999}) out << h.percentile(p) / 1000.0 << "  ";
+    out << h.max() / 1000.0 << "\n";
+}
+
+static void write_stage_percentiles(std::ostream& out, const StageLatencies& lat) {
+    out << "\nLatency Percentiles (μs):\n";
+    out << "Stage      p50    p90    p99    p99.9    max\n";
+    write_percentile_row(out, "Stage1   ", lat.stage1);
+    write_percentile_row(out, "Process  ", lat.processing);
+    write_percentile_row(out, "Stage2   ", lat.stage2);
+    write_percentile_row(out, "Strategy ", lat.strategy);
+    write_percentile_row(out, "Total    ", lat.total);
+}
+
+static nlohmann::ordered_json percentiles_json(const LatencyHistogram& h) {
+    return {{"p50", h.percentile(0.50) / 1000.0}, {"p90", h.percentile(0.90) / 1000.0},
+            {"p99", h.percentile(0.99) / 1000.0}, {"p999", h.percentile(0.999) / 1000.0},
+            {"max", h.max() / 1000.0}};
+}
+
+static nlohmann::ordered_json stage_percentiles_json(const StageLatencies& lat) {
+    return {{"stage1", percentiles_json(lat.stage1)}, {"process", percentiles_json(lat.processing)},
+            {"stage2", percentiles_json(lat.stage2)}, {"strategy", percentiles_json(lat.strategy)},
+            {"total", percentiles_json(lat.total)}};
+}
+
+// Double-buffered StageLatencies for one writer and the monitor, rotated
+// without locks (a WriterReaderPhaser). The writer brackets each batch with
+// enter()/exit() and records into the buffer enter() returned; rotate()
+// switches buffers, waits for a batch still in the old one to exit, and
+// returns it for the monitor to read and clear before the next rotate().
+class IntervalLatencies {
+public:
+    StageLatencies& enter() {
+        entered_ = start_.fetch_add(1, std::memory_order_seq_cst);
+        return buffers_[entered_ >> 63];
+    }
+
+    void exit() {
+        end_[entered_ >> 63].fetch_add(1, std::memory_order_release);
+    }
+
+    StageLatencies& rotate() {
+        const uint64_t next = (start_.load(std::memory_order_relaxed) >> 63) ^ 1;
+        end_[next].store(next << 63, std::memory_order_relaxed);
+        const uint64_t at_flip = start_.exchange(next << 63, std::memory_order_seq_cst);
+        while (end_[next ^ 1].load(std::memory_order_acquire) != at_flip)
+            cpu_relax();
+        return buffers_[next ^ 1];
+    }
+
+    // Both buffers; only once the writer has stopped.
+    const StageLatencies& buffer(int i) const { return buffers_[i]; }
+
+private:
+    // The top bit of each counter is the phase, the rest counts batches.
+    alignas(64) std::atomic<uint64_t> start_{0};
+    uint64_t entered_ = 0; // writer-owned
+    alignas(64) std::array<std::atomic<uint64_t>, 2> end_{0, uint64_t(1) << 63};
+    std::array<StageLatencies, 2> buffers_;
+};
+
+// ==========================================================
+// Pipeline
+// ==========================================================
+// Files a scenario writes into the results directory.
+struct ScenarioOutputs {
+    std::string summary_path;
+    std::ofstream log;
+    std::ofstream summary;
+    std::ofstream timeline; // one CSV row per monitor interval
+    std::ofstream metrics;  // JSON lines, only with metrics_jsonl
+    std::string trace_path; // written only with capture_trace
+
+    ScenarioOutputs(const std::string& dir, const std::string& scenario, bool metrics_jsonl)
+        : summary_path(dir + "/" + scenario + "_summary.txt"),
+          log(dir + "/" + scenario + "_log.txt"),
+          summary(summary_path),
+          timeline(dir + "/" + scenario + "_timeline.csv"),
+          trace_path(dir + "/" + scenario + "_trace.bin") {
+        if (metrics_jsonl) metrics.open(dir + "/" + scenario + "_metrics.jsonl");
+    }
+};
+
+// Runs one scenario on workers and returns its results.json record.
+// Worker slots: processors first, then strategies, then producers. tables
+// is where routing_reload publishes new routes (null for static routing).
+template <typename Routing>
+static nlohmann::ordered_json run_scenario(const Config& cfg, const Routing& routing, const std::string& scenario,
+                                           ScenarioOutputs& out, WorkerPool& workers, RoutingTables* tables) {
+    std::ofstream& log_file = out.log;
+    std::ofstream& summary_file = out.summary;
+    std::ofstream& metrics_file = out.metrics;
+    const TscCalibration tsc = process_tsc();
+    const int fallbacks_before = hugetlb_fallbacks.load();
+    workers.restore_affinity(); // drop the previous scenario's monitor pinning
+    ring_mappings.bypass(cfg.placement.numa != NumaPolicy::None);
+    const Clock clock(parse_clock_source(cfg.clock), tsc);
+    std::cout << "Running scenario: " << scenario
+              << " (stage1 ingress: " << ingress_topology_name(cfg.stage1_ingress) << ")" << std::endl;
+    if (cfg.stage1_ingress == IngressTopology::Shared && cfg.producer_count > 1)
+        std::cerr << "Warning: shared stage1 ingress with " << cfg.producer_count
+                  << " producers violates the SPSC contract\n";
+
+    if (cfg.stage1_ingress == IngressTopology::ByteLanes &&
+        sizeof(Message) + cfg.payload_max_bytes > ByteRing::kMaxRecord)
+        throw std::runtime_error("producers.payload_bytes too large for byte_lanes");
+    Stage1Ingress stage1(cfg.stage1_ingress, cfg.producer_count, cfg.processor_count,
+                         QueueSpec{cfg.stage1_capacity, cfg.huge_pages, true}, sizeof(Message) + cfg.payload_max_bytes);
+    // Every processor may feed every strategy, so each strategy gets one SPSC
+    // lane per processor.
+    std::vector<std::unique_ptr<SPSCLaneSet>> stage2_queues;
+    for (int i = 0; i < cfg.strategy_count; ++i)
+        stage2_queues.push_back(std::make_unique<SPSCLaneSet>(cfg.processor_count,
+                                                              QueueSpec{cfg.stage2_capacity, cfg.huge_pages}));
+
+    std::vector<uint64_t> processor_cost_ticks, strategy_cost_ticks, strategy_call_ticks;
+    for (auto ns : cfg.processor_cost_ns) processor_cost_ticks.push_back(tsc.to_ticks(ns));
+    for (auto ns : cfg.strategy_cost_ns) strategy_cost_ticks.push_back(tsc.to_ticks(ns));
+    for (auto ns : cfg.strategy_call_overhead_ns) strategy_call_ticks.push_back(tsc.to_ticks(ns));
+
+    // Lifecycle: warm-up -> measure -> stop producers -> drain stage 1 ->
+    // drain stage 2. Each stage exits once its upstream is done and its
+    // input is empty; stop_flag is the hard stop if draining times out.
+    std::atomic<bool> stop_flag = false;
+    std::atomic<bool> producers_stop = false;
+    std::atomic<bool> producers_done = false;  // stage 1 gets no more input
+    std::atomic<bool> processors_done = false; // stage 2 gets no more input
+    std::atomic<int> processors_exited = 0, strategies_exited = 0;
+    // Counts a thread out however its body returns.
+    struct ExitCounter {
+        std::atomic<int>& exited;
+        ~ExitCounter() { exited.fetch_add(1, std::memory_order_release); }
+    };
+    // Only messages stamped at or after this feed the latency statistics.
+    std::atomic<uint64_t> measure_from_ns = cfg.warmup_secs > 0 ? UINT64_MAX : 0;
+    std::vector<ThreadCounters> producer_counters(cfg.producer_count);
+    std::vector<ThreadCounters> processor_counters(cfg.processor_count);
+    std::vector<ThreadCounters> strategy_counters(cfg.strategy_count);
+    // Stage-1 drops come from producers (rows 0..P-1) or from the processor
+    // shedding its own backlog (row P + proc_id); stage 2 likewise with
+    // processors and strategies.
+    const OverloadConfig& stage1_overload = cfg.stage1_overload;
+    const OverloadConfig& stage2_overload = cfg.stage2_overload;
+    DropCounters stage1_drops(cfg.producer_count + cfg.processor_count, cfg.processor_count);
+    DropCounters stage2_drops(cfg.processor_count + cfg.strategy_count, cfg.strategy_count);
+
+    // Notifications are only sent towards stages configured to park.
+    std::vector<ParkingSpot> producer_spots(cfg.producer_count);
+    std::vector<ParkingSpot> processor_in_spots(cfg.processor_count);  // waiting for stage-1 data
+    std::vector<ParkingSpot> processor_out_spots(cfg.processor_count); // waiting for stage-2 room
+    std::vector<ParkingSpot> strategy_spots(cfg.strategy_count);
+    const bool park_producers = cfg.wait.producer == WaitKind::Park;
+    const bool park_processors = cfg.wait.processor == WaitKind::Park;
+    const bool park_strategies = cfg.wait.strategy == WaitKind::Park;
+    // Strategies record into per-interval buffers; the monitor folds every
+    // rotated interval into the run totals.
+    std::vector<std::unique_ptr<IntervalLatencies>> strategy_latencies;
+    for (int i = 0; i < cfg.strategy_count; ++i)
+        strategy_latencies.push_back(std::make_unique<IntervalLatencies>());
+    StageLatencies latencies;
+    // Intended origin: each producer's lag behind its schedule at enqueue.
+    const bool intended_origin = cfg.latency_origin == LatencyOrigin::Intended;
+    std::vector<std::unique_ptr<LatencyHistogram>> send_lags;
+    for (int i = 0; i < cfg.producer_count; ++i)
+        send_lags.push_back(std::make_unique<LatencyHistogram>());
+    // The closed-loop sender interval the correction assumes: the base
+    // per-producer rate (bursts are not modelled).
+    const uint64_t co_interval_ns =
+        cfg.co_correction && cfg.rate.paced() ? (uint64_t)(1e9 / cfg.rate.messages_per_sec) : 0;
+    if (cfg.co_correction && !cfg.rate.paced())
+        std::cerr << "Warning: co_correction needs paced producers (messages_per_sec); disabled\n";
+
+    // Payloads go through per-producer pools unless stage 1 carries them
+    // inline, in which case the processor reads them straight from the ring.
+    const bool payloads = cfg.payload_max_bytes > 0;
+    const bool pooled_payloads = payloads && !stage1.inline_payloads();
+    std::vector<std::unique_ptr<PayloadPool>> payload_pools;
+    if (pooled_payloads)
+        for (int pid = 0; pid < cfg.producer_count; ++pid)
+            payload_pools.push_back(std::make_unique<PayloadPool>(cfg.payload_pool_slots, cfg.payload_max_bytes));
+    // A dropped message hands its payload slot back to the producer's pool.
+    auto release_payloads = [&](const Message* msgs, size_t n) {
+        if (!pooled_payloads) return;
+        for (size_t i = 0; i < n; ++i) payload_pools[msgs[i].producer_id]->release(msgs[i].payload_slot);
+        if (n && park_producers) notify_parked(producer_spots);
+    };
+    struct alignas(64) PayloadStats {
+        uint64_t bytes = 0;
+        uint64_t checksum = 0;
+
+        void read(const uint8_t* data, size_t n) {
+            checksum += payload_checksum(data, n);
+            bytes += n;
+        }
+    };
+    std::vector<PayloadStats> processor_payloads(cfg.processor_count), strategy_payloads(cfg.strategy_count);
+
+    // Consumers pin themselves and place (and prefault) their input queues
+    // before any producer starts; main waits on the latch, then starts producers.
+    const Placement& placement = cfg.placement;
+    std::latch consumers_ready(cfg.processor_count + cfg.strategy_count);
+    // With perf_counters, every thread opens its own counters first; the
+    // monitor enables them for the measure window only.
+    auto make_perf = [&](int n) {
+        std::vector<std::unique_ptr<PerfCounters>> v;
+        for (int i = 0; cfg.perf_counters && i < n; ++i) v.push_back(std::make_unique<PerfCounters>());
+        return v;
+    };
+    auto producer_perf = make_perf(cfg.producer_count);
+    auto processor_perf = make_perf(cfg.processor_count);
+    auto strategy_perf = make_perf(cfg.strategy_count);
+    std::latch perf_opened(cfg.perf_counters ? cfg.producer_count + cfg.processor_count + cfg.strategy_count : 0);
+    auto open_perf = [&](std::vector<std::unique_ptr<PerfCounters>>& role, int idx) {
+        if (!cfg.perf_counters) return;
+        role[idx]->open();
+        perf_opened.count_down();
+    };
+    // init writes the consumer's own queue state (MPMC cell sequence numbers)
+    // once its memory is bound. Consumers wait for each other, as work-stealing
+    // peers pop from each other's steal queues.
+    auto place_consumer = [&](const char* role, int idx, int cpu, const std::vector<MemoryRegion>& regions,
+                              const std::function<void()>& init = {}) {
+        if (!pin_current_thread(cpu))
+            std::cerr << "Warning: could not pin " << role << " " << idx << " to CPU " << cpu << "\n";
+        if (placement.numa == NumaPolicy::Bind) {
+            int node = numa_node_of_cpu(cpu);
+            for (auto& r : regions)
+                if (!bind_to_node(r, node)) {
+                    std::cerr << "Warning: mbind to node " << node << " failed for " << role << " " << idx << "\n";
+                    break;
+                }
+        }
+        if (init) init();
+        if (placement.numa != NumaPolicy::None || cfg.prefault_queues)
+            for (auto& r : regions) prefault(r);
+        consumers_ready.arrive_and_wait();
+    };
+    for (int i = 0; i < (int)placement.strategies.size() && placement.monitor >= 0; ++i)
+        if (placement.strategies[i] == placement.monitor)
+            std::cerr << "Warning: monitor CPU " << placement.monitor << " is shared with strategy " << i << "\n";
+    for (int i = 0; i < (int)placement.processors.size() && placement.monitor >= 0; ++i)
+        if (placement.processors[i] == placement.monitor)
+            std::cerr << "Warning: monitor CPU " << placement.monitor << " is shared with processor " << i << "\n";
+    for (int i = 0; i < (int)placement.producers.size() && placement.monitor >= 0; ++i)
+        if (placement.producers[i] == placement.monitor)
+            std::cerr << "Warning: monitor CPU " << placement.monitor << " is shared with producer " << i << "\n";
+
+    // Trace files are opened before any thread starts, so a bad one fails the
+    // scenario cleanly. Producer pid replays stream pid % streams; capture
+    // takes measure-window deliveries in the order strategies claim space.
+    std::unique_ptr<TraceReader> trace;
+    if (cfg.type_source == TypeSource::Trace) {
+        trace = std::make_unique<TraceReader>(cfg.trace_file);
+        for (const TraceRecord& r : trace->records())
+            if (r.msg_type >= MAX_MSG_TYPES)
+                throw std::runtime_error("Trace " + cfg.trace_file + " has msg_type " + std::to_string(r.msg_type) +
+                                         " out of range");
+        if (trace->streams().size() != (size_t)cfg.producer_count)
+            std::cerr << "Warning: trace has " << trace->streams().size() << " producer streams, replaying with "
+                      << cfg.producer_count << " producers\n";
+    }
+    std::unique_ptr<TraceWriter> capture;
+    if (cfg.capture_trace) capture = std::make_unique<TraceWriter>(out.trace_path, cfg.capture_max_records);
+
+    // With routing_reload in affinity mode, a producer moves an ordered type
+    // to new stage-1 routes only after every earlier message of that
+    // (producer, type) key has been delivered; strategies publish per key
+    // how far delivery has got.
+    const bool reload_fences = cfg.routing_reload && tables && cfg.ordering_mode == OrderingMode::Affinity;
+    struct alignas(64) DeliveredSeq {
+        std::atomic<uint32_t> next{0};
+    };
+    std::vector<DeliveredSeq> delivered_next(reload_fences ? cfg.producer_count * MAX_MSG_TYPES : 0);
+    std::atomic<uint64_t> fence_waits{0}, fence_timeouts{0};
+
+    // Everything below that can throw is built before the first task starts:
+    // once pipeline threads run, unwinding would free state they still use.
+    AliasTable type_table(cfg.type_weights);
+    std::vector<std::vector<uint8_t>> type_tapes(cfg.producer_count, std::vector<uint8_t>(1));
+    if (cfg.type_source == TypeSource::Tape) {
+        for (int pid = 0; pid < cfg.producer_count; ++pid) {
+            Xoshiro256 rng(pid + 1);
+            type_tapes[pid].resize(cfg.tape_length);
+            for (auto& type : type_tapes[pid]) type = type_table.sample(rng());
+        }
+    }
+
+    // Types whose order each strategy must restore (reorder mode only).
+    std::vector<std::vector<bool>> reorder_types(cfg.strategy_count, std::vector<bool>(MAX_MSG_TYPES, false));
+    if (cfg.ordering_mode == OrderingMode::Reorder) {
+        for (int type = 0; type < MAX_MSG_TYPES; ++type)
+            if (cfg.ordering_required[type])
+                reorder_types[cfg.stage2_routing[type]][type] = true;
+    }
+    std::vector<std::unique_ptr<OrderChecker>> order_checkers;
+    std::vector<std::unique_ptr<ReorderBuffer>> reorder_buffers;
+    for (int sid = 0; sid < cfg.strategy_count; ++sid) {
+        order_checkers.push_back(std::make_unique<OrderChecker>(cfg.producer_count));
+        reorder_buffers.push_back(std::make_unique<ReorderBuffer>(
+            cfg.producer_count, reorder_types[sid], cfg.reorder_window, cfg.reorder_max_hold_ns));
+    }
+
+    // What each strategy's handler did; the coalescing wait is the latency
+    // batched mode adds in front of the handler.
+    const bool batched_strategies = cfg.strategy_mode == StrategyMode::Batched;
+    struct HandlerStats {
+        TypeAggregates aggregates; // with handler "aggregate"
+        uint64_t calls = 0;        // batched mode; per_message makes one per message
+        LatencyHistogram coalesce_wait;
+    };
+    std::vector<std::unique_ptr<HandlerStats>> handler_stats;
+    for (int sid = 0; sid < cfg.strategy_count; ++sid) handler_stats.push_back(std::make_unique<HandlerStats>());
+
+    // ==========================================================
+    // Processors
+    // ==========================================================
+    const bool work_stealing = cfg.processor_mode == ProcessorMode::WorkStealing;
+    struct alignas(64) StealStats {
+        uint64_t steals = 0;
+        uint64_t stolen = 0;
+    };
+    std::vector<StealStats> steal_stats(cfg.processor_count);
+    std::vector<std::unique_ptr<MPMCQueue<Message>>> steal_queues;
+    if (work_stealing) {
+        for (int i = 0; i < cfg.processor_count; ++i)
+            steal_queues.push_back(std::make_unique<MPMCQueue<Message>>(QueueSpec{STEAL_QUEUE_SIZE, cfg.huge_pages, true}));
+    }
+
+    const size_t processor_slot = 0;
+    for (int proc_id = 0; proc_id < cfg.processor_count; ++proc_id) {
+        workers.run(processor_slot + proc_id, [&, proc_id]() {
+            ExitCounter exit_counter{processors_exited};
+            open_perf(processor_perf, proc_id);
+            std::vector<MemoryRegion> regions = stage1.regions(proc_id);
+            if (work_stealing) regions.push_back({steal_queues[proc_id]->storage(), steal_queues[proc_id]->storage_bytes()});
+            place_consumer("processor", proc_id, Placement::core_for(placement.processors, proc_id), regions, [&] {
+                stage1.init_owned(proc_id);
+                if (work_stealing) steal_queues[proc_id]->init_cells();
+            });
+
+            std::array<Message, MAX_BATCH> batch;
+            Stage2Outbox outbox(cfg.strategy_count);
+            Waiter idle_wait(cfg.wait.processor, processor_in_spots[proc_id]);
+            Waiter push_wait(cfg.wait.processor, processor_out_spots[proc_id]);
+            ThreadCounters& counters = processor_counters[proc_id];
+            Routing routes = routing; // picks up reloaded tables before each batch and idle wait
+            auto adopt_routes = [&] {
+                if (routes.refresh()) counters.epoch.store(routes.epoch(), std::memory_order_release);
+            };
+            StallTimer stall(clock, counters);
+            std::vector<uint32_t> sampled(cfg.strategy_count, 0);
+
+            // Pulls from stage 1, letting parked producers know there is room.
+            auto read_payload = [&](const uint8_t* data, size_t bytes) {
+                processor_payloads[proc_id].read(data, bytes);
+            };
+            // drop_oldest: discard the oldest backlog beyond max_depth first.
+            std::array<Message, MAX_BATCH> shed;
+            auto shed_backlog = [&] {
+                size_t depth = stage1.size(proc_id);
+                size_t excess = depth > stage1_overload.max_depth ? depth - stage1_overload.max_depth : 0;
+                while (excess) {
+                    size_t got = stage1.pop_bulk(routing.ingress(), proc_id, shed.data(),
+                                                 std::min<size_t>(excess, MAX_BATCH), [](const uint8_t*, size_t) {});
+                    if (got == 0) break;
+                    release_payloads(shed.data(), got);
+                    stage1_drops.add(cfg.producer_count + proc_id, proc_id, got);
+                    excess -= std::min(excess, got);
+                }
+            };
+            auto pull = [&](Message* out, size_t max) {
+                if (stage1_overload.policy == OverloadPolicy::DropOldest) shed_backlog();
+                size_t got = stage1.pop_bulk(routing.ingress(), proc_id, out, max, read_payload);
+                if (got && park_producers) notify_parked(producer_spots);
+                return got;
+            };
+
+            // Runs processor work on msgs and forwards them to stage 2.
+            // Returns false if stopped while blocked on a full stage-2 queue.
+            auto process = [&](Message* msgs, size_t n) {
+                // One clock read per batch; per-message offsets come from the
+                // TSC that the busy work reads anyway.
+                adopt_routes();
+                uint64_t t_now = clock.now();
+                uint64_t batch_tsc = read_tsc();
+                uint64_t elapsed = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    Message& msg = msgs[i];
+                    uint64_t begin = elapsed;
+                    if (uint64_t cost = processor_cost_ticks[msg.msg_type]) {
+                        busy_work(cost);
+                        elapsed = read_tsc() - batch_tsc;
+                    }
+                    msg.processor_id = proc_id;
+                    msg.dequeued_offset_ns = offset_ns(t_now + tsc.to_ns(begin), msg.timestamp_ns);
+                    msg.processed_offset_ns = offset_ns(t_now + tsc.to_ns(elapsed), msg.timestamp_ns);
+                    outbox.route(routes, msg);
+                }
+
+                // Counted once pushed or shed by the overload policy; a stop
+                // mid-push leaves out the rest of the batch, as the --role
+                // processor does.
+                size_t forwarded = 0;
+                for (int strat_id = 0; strat_id < routing.strategy_count(); ++strat_id) {
+                    std::span<Message> box = outbox.take(strat_id);
+                    size_t len = box.size();
+                    if (len == 0) continue;
+                    Message* out = box.data();
+                    if (stage2_overload.policy == OverloadPolicy::Sample &&
+                        stage2_queues[strat_id]->size() >= stage2_overload.max_depth) {
+                        // Dropped messages are moved behind the kept ones.
+                        size_t kept = 0;
+                        for (size_t i = 0; i < len; ++i)
+                            if (++sampled[strat_id] % stage2_overload.sample_every == 0) std::swap(out[kept++], out[i]);
+                        release_payloads(out + kept, len - kept);
+                        stage2_drops.add(proc_id, strat_id, len - kept);
+                        forwarded += len - kept;
+                        len = kept;
+                    }
+                    auto& lane = stage2_queues[strat_id]->lane(proc_id);
+                    size_t sent = 0;
+                    while (sent < len) {
+                        sent += lane.push_bulk(out + sent, len - sent);
+                        if (park_strategies) strategy_spots[strat_id].notify();
+                        if (sent < len) {
+                            if (stop_flag.load()) {
+                                ThreadCounters::add(counters.messages, forwarded + sent);
+                                return false;
+                            }
+                            if (stage2_overload.writer_drops()) {
+                                release_payloads(out + sent, len - sent);
+                                stage2_drops.add(proc_id, strat_id, len - sent);
+                                break;
+                            }
+                            stall.blocked();
+                            push_wait.idle([&] {
+                                return stop_flag.load(std::memory_order_relaxed) || lane.size() < lane.capacity();
+                            });
+                        }
+                    }
+                    push_wait.reset();
+                    stall.resumed();
+                    forwarded += len;
+                }
+                ThreadCounters::add(counters.messages, forwarded);
+                return true;
+            };
+
+            if (!work_stealing) {
+                auto ready = [&] {
+                    return stop_flag.load(std::memory_order_relaxed) ||
+                           producers_done.load(std::memory_order_relaxed) || stage1.size(proc_id) > 0;
+                };
+                while (!stop_flag.load(std::memory_order_relaxed)) {
+                    size_t n = pull(batch.data(), cfg.processor_batch);
+                    if (n == 0) {
+                        if (producers_done.load(std::memory_order_acquire) && stage1.size(proc_id) == 0) return;
+                        ThreadCounters::add(counters.empty_waits, 1);
+                        adopt_routes();
+                        idle_wait.idle(ready);
+                        continue;
+                    }
+                    idle_wait.reset();
+                    if (!process(batch.data(), n)) return;
+                }
+                return;
+            }
+
+            // Work stealing: ordered types are processed here in arrival
+            // order; everything else is parked in this processor's steal
+            // queue, which the owner drains FIFO and idle peers raid.
+            // The owner keeps pulling stage-1 backlog into the steal queue
+            // (a few batches per round) so a slow processor's backlog becomes
+            // visible to its peers instead of sitting in its SPSC lanes.
+            constexpr int kRefillRounds = 8;
+            auto& own = *steal_queues[proc_id];
+            std::array<Message, MAX_BATCH> work;
+            // Peers filling their steal queues do not notify; a parked thief
+            // rechecks them when the park times out.
+            auto ready = [&] {
+                return stop_flag.load(std::memory_order_relaxed) || producers_done.load(std::memory_order_relaxed) ||
+                       stage1.size(proc_id) > 0 || own.size() > 0;
+            };
+            while (!stop_flag.load(std::memory_order_relaxed)) {
+                size_t n = 0;
+                for (int round = 0; round < kRefillRounds && own.size() < STEAL_QUEUE_SIZE / 2; ++round) {
+                    size_t got = pull(batch.data(), cfg.processor_batch);
+                    if (got == 0) break;
+                    n += got;
+                    size_t local = 0;
+                    for (size_t i = 0; i < got; ++i) {
+                        if (!routing.ordered(batch[i].msg_type) && own.push(batch[i])) continue;
+                        batch[local++] = batch[i];
+                    }
+                    if (local && !process(batch.data(), local)) return;
+                }
+
+                size_t m = 0;
+                while (m < (size_t)cfg.processor_batch && own.pop(work[m])) ++m;
+                if (m && !process(work.data(), m)) return;
+                if (n || m) {
+                    idle_wait.reset();
+                    continue;
+                }
+
+                int victim = -1;
+                size_t victim_depth = 0;
+                for (int peer = 0; peer < routing.processor_count(); ++peer) {
+                    size_t depth = peer == proc_id ? 0 : steal_queues[peer]->size();
+                    if (depth > victim_depth) {
+                        victim = peer;
+                        victim_depth = depth;
+                    }
+                }
+                size_t got = 0;
+                if (victim >= 0) {
+                    auto& q = *steal_queues[victim];
+                    while (got < (size_t)cfg.steal_batch && q.pop(work[got])) {
+                        work[got].flags |= MSG_STOLEN;
+                        ++got;
+                    }
+                }
+                if (got == 0) {
+                    if (producers_done.load(std::memory_order_acquire) && stage1.size(proc_id) == 0 &&
+                        own.size() == 0)
+                        return;
+                    ThreadCounters::add(counters.empty_waits, 1);
+                    adopt_routes();
+                    idle_wait.idle(ready);
+                    continue;
+                }
+                idle_wait.reset();
+                steal_stats[proc_id].steals++;
+                steal_stats[proc_id].stolen += got;
+                if (!process(work.data(), got)) return;
+            }
+        });
+    }
+
+    // ==========================================================
+    // Strategies
+    // ==========================================================
+    const size_t strategy_slot = processor_slot + cfg.processor_count;
+    for (int sid = 0; sid < cfg.strategy_count; ++sid) {
+        workers.run(strategy_slot + sid, [&, sid]() {
+            ExitCounter exit_counter{strategies_exited};
+            open_perf(strategy_perf, sid);
+            std::vector<MemoryRegion> regions;
+            stage2_queues[sid]->append_regions(regions);
+            place_consumer("strategy", sid, Placement::core_for(placement.strategies, sid), regions);
+
+            std::array<Message, MAX_BATCH> batch;
+            IntervalLatencies& intervals = *strategy_latencies[sid];
+            StageLatencies* lat = nullptr; // the current batch's buffer
+            OrderChecker& order = *order_checkers[sid];
+            ReorderBuffer& reorder = *reorder_buffers[sid];
+            const uint64_t cost = strategy_cost_ticks[sid];
+            const uint64_t call_cost = strategy_call_ticks[sid];
+            Waiter wait(cfg.wait.strategy, strategy_spots[sid]);
+            ThreadCounters& counters = strategy_counters[sid];
+            auto ready = [&] {
+                return stop_flag.load(std::memory_order_relaxed) || processors_done.load(std::memory_order_relaxed) ||
+                       stage2_queues[sid]->size() > 0;
+            };
+
+            uint64_t t_end = 0, batch_tsc = 0, elapsed = 0, handled = 0, measure_from = 0;
+            PayloadStats& payload_stats = strategy_payloads[sid];
+            std::optional<TraceWriter::Appender> recorder;
+            if (capture) recorder.emplace(*capture);
+            HandlerStats& handler = *handler_stats[sid];
+            std::unique_ptr<StrategyBatch> pending;
+            if (batched_strategies) pending = std::make_unique<StrategyBatch>();
+
+            // Batched mode: one handler call for everything pending, then the
+            // per-message latency bookkeeping into the given buffer.
+            auto flush = [&](StageLatencies& into) {
+                ++handler.calls;
+                const StrategyBatch& b = *pending;
+                const uint64_t call_ns = clock.now();
+                if (const uint64_t work = call_cost + b.size * cost) busy_work(work);
+                const uint64_t done_ns = clock.now();
+                if (cfg.strategy_aggregates) aggregate_by_type(b, done_ns, handler.aggregates);
+                for (size_t i = 0; i < b.size; ++i) {
+                    if (!b.measured[i]) continue;
+                    uint64_t processed_ns = b.timestamp_ns[i] + b.processed_offset_ns[i];
+                    into.stage1.record(b.dequeued_offset_ns[i]);
+                    into.processing.record(b.processed_offset_ns[i] - b.dequeued_offset_ns[i]);
+                    into.stage2.record(b.arrived_ns[i] - processed_ns);
+                    into.strategy.record(done_ns - b.arrived_ns[i]);
+                    into.total.record(done_ns - b.timestamp_ns[i]);
+                    if (b.flags[i] & MSG_STOLEN) into.stolen_total.record(done_ns - b.timestamp_ns[i]);
+                    handler.coalesce_wait.record(call_ns - b.arrived_ns[i]);
+                }
+                pending->size = 0;
+            };
+            auto flush_outside_batch = [&] {
+                flush(intervals.enter());
+                intervals.exit();
+            };
+            auto deadline_passed = [&] {
+                return clock.now() - pending->oldest_ns() >= cfg.coalesce_max_wait_ns;
+            };
+            // While messages are coalescing the strategy does not park, so
+            // the deadline is kept.
+            auto idle = [&] {
+                if (!pending || pending->empty()) {
+                    ThreadCounters::add(counters.empty_waits, 1);
+                    wait.idle(ready);
+                } else if (deadline_passed()) {
+                    flush_outside_batch();
+                } else {
+                    cpu_relax();
+                }
+            };
+
+            auto deliver = [&](const Message& msg) {
+                order.check(msg);
+                uint64_t start_ns = t_end + tsc.to_ns(elapsed);
+                if ((call_cost || cost) && !pending) {
+                    busy_work(call_cost + cost);
+                    elapsed = read_tsc() - batch_tsc;
+                }
+                if (pooled_payloads) {
+                    PayloadPool& pool = *payload_pools[msg.producer_id];
+                    payload_stats.read(pool.data(msg.payload_slot), msg.payload_bytes);
+                    pool.release(msg.payload_slot);
+                    elapsed = read_tsc() - batch_tsc;
+                }
+                ++handled;
+                if (reload_fences && routing.ordered(msg.msg_type))
+                    delivered_next[order_key(msg)].next.store(msg.sequence + 1, std::memory_order_release);
+                const bool in_window = msg.timestamp_ns >= measure_from;
+                if (recorder && in_window) recorder->append(msg);
+                if (pending) {
+                    pending->add(msg, start_ns, in_window);
+                    if (pending->size == cfg.coalesce_max) {
+                        flush(*lat);
+                        elapsed = read_tsc() - batch_tsc;
+                    }
+                    return;
+                }
+                uint64_t done_ns = t_end + tsc.to_ns(elapsed);
+                if (cfg.strategy_aggregates) handler.aggregates.add(msg.msg_type, done_ns - msg.timestamp_ns);
+                if (!in_window) return;
+                uint64_t processed_ns = msg.timestamp_ns + msg.processed_offset_ns;
+                lat->stage1.record(msg.dequeued_offset_ns);
+                lat->processing.record(msg.processed_offset_ns - msg.dequeued_offset_ns);
+                lat->stage2.record(start_ns - processed_ns);
+                lat->strategy.record(done_ns - start_ns);
+                lat->total.record(done_ns - msg.timestamp_ns);
+                if (msg.flags & MSG_STOLEN) lat->stolen_total.record(done_ns - msg.timestamp_ns);
+            };
+
+            // drop_oldest: discard the oldest backlog beyond max_depth first.
+            auto shed_backlog = [&] {
+                size_t depth = stage2_queues[sid]->size();
+                size_t excess = depth > stage2_overload.max_depth ? depth - stage2_overload.max_depth : 0;
+                while (excess) {
+                    size_t got = stage2_queues[sid]->pop_bulk(batch.data(), std::min<size_t>(excess, MAX_BATCH));
+                    if (got == 0) break;
+                    release_payloads(batch.data(), got);
+                    stage2_drops.add(cfg.processor_count + sid, sid, got);
+                    excess -= std::min(excess, got);
+                }
+            };
+
+            while (!stop_flag.load(std::memory_order_relaxed)) {
+                if (stage2_overload.policy == OverloadPolicy::DropOldest) shed_backlog();
+                size_t n = stage2_queues[sid]->pop_bulk(batch.data(), cfg.strategy_batch);
+                if (n == 0 && !reorder.holding()) {
+                    if (processors_done.load(std::memory_order_acquire) && stage2_queues[sid]->size() == 0) break;
+                    idle();
+                    continue;
+                }
+                if (n && park_processors) notify_parked(processor_out_spots);
+                if (n && pooled_payloads && park_producers) notify_parked(producer_spots);
+                t_end = clock.now();
+                batch_tsc = read_tsc();
+                elapsed = 0;
+                handled = 0;
+                measure_from = measure_from_ns.load(std::memory_order_relaxed);
+                lat = &intervals.enter();
+                for (size_t i = 0; i < n; ++i)
+                    reorder.accept(batch[i], t_end, deliver);
+                reorder.expire(t_end, deliver);
+                intervals.exit();
+                if (pending && !pending->empty() && deadline_passed()) flush_outside_batch();
+
+                if (handled) ThreadCounters::add(counters.messages, handled);
+                if (n == 0) {
+                    idle();
+                } else {
+                    wait.reset();
+                }
+            }
+            if (pending && !pending->empty()) flush_outside_batch();
+        });
+    }
+
+    // ==========================================================
+    // Producers
+    // ==========================================================
+    consumers_ready.wait();
+    const uint64_t run_start_ns = clock.now();
+    const size_t producer_slot = strategy_slot + cfg.strategy_count;
+    for (int pid = 0; pid < cfg.producer_count; ++pid) {
+        workers.run(producer_slot + pid, [&, pid]() {
+            open_perf(producer_perf, pid);
+            int cpu = Placement::core_for(placement.producers, pid);
+            if (!pin_current_thread(cpu))
+                std::cerr << "Warning: could not pin producer " << pid << " to CPU " << cpu << "\n";
+            PayloadPool* pool = pooled_payloads ? payload_pools[pid].get() : nullptr;
+            if (pool && placement.numa != NumaPolicy::None) prefault(pool->region());
+            const size_t payload_span = cfg.payload_max_bytes - cfg.payload_min_bytes + 1;
+            const bool inline_payloads = routing.ingress() == IngressTopology::ByteLanes;
+
+            uint64_t count = 0;
+            std::array<uint32_t, MAX_MSG_TYPES> seq{};
+            Xoshiro256 rng(pid + 1);
+            const auto& tape = type_tapes[pid];
+            const size_t tape_mask = tape.size() - 1;
+            std::span<const TraceRecord> replay;
+            if (trace) replay = trace->streams()[pid % trace->streams().size()];
+            size_t replay_pos = 0;
+            const TraceRecord* rec = nullptr;
+            auto payload_size = [&] {
+                return (uint32_t)(rec ? std::clamp<size_t>(rec->payload_bytes, cfg.payload_min_bytes, cfg.payload_max_bytes)
+                                      : cfg.payload_min_bytes + rng() % payload_span);
+            };
+            // A replay keeps to the trace's timeline, catching up after a stall.
+            Pacer pacer(cfg.rate, clock, run_start_ns, park_producers,
+                        intended_origin || trace ? Pacer::kNoLagLimit : Pacer::kMaxLagNs);
+            LatencyHistogram& send_lag = *send_lags[pid];
+            Stage1Balancer balancer(cfg.stage1_routing, stage1, pid);
+            Waiter wait(cfg.wait.producer, producer_spots[pid]);
+            ThreadCounters& counters = producer_counters[pid];
+            // A producer's batch is one message: it checks for a reloaded
+            // table before each. fenced marks ordered types whose stage-1
+            // route changed and whose next message has to wait for the key.
+            Routing routes = routing;
+            std::array<bool, MAX_MSG_TYPES> fenced{};
+            StallTimer stall(clock, counters);
+            // Sample policy: which processors are past max_depth, refreshed
+            // every kPressureRefresh messages rather than on every send.
+            constexpr uint64_t kPressureRefresh = 32;
+            std::vector<uint8_t> pressured(cfg.processor_count, 0);
+            std::vector<uint32_t> sampled(cfg.processor_count, 0);
+            uint64_t offered = 0;
+            Message msg{};
+            while (!producers_stop.load(std::memory_order_relaxed)) {
+                if constexpr (!Routing::is_static) {
+                    if (routes.refresh()) {
+                        for (int type = 0; reload_fences && type < MAX_MSG_TYPES; ++type)
+                            if (routing.ordered(type) && balancer.routes()[type] != routes.stage1_routes()[type])
+                                fenced[type] = true;
+                        balancer.set_routes(routes.stage1_routes());
+                        counters.epoch.store(routes.epoch(), std::memory_order_release);
+                    }
+                }
+                if (trace) {
+                    rec = &replay[replay_pos];
+                    if (++replay_pos == replay.size()) replay_pos = 0;
+                    msg.msg_type = rec->msg_type;
+                } else {
+                    msg.msg_type = cfg.type_source == TypeSource::Tape
+                        ? tape[count++ & tape_mask]
+                        : type_table.sample(rng());
+                }
+                msg.producer_id = pid;
+                msg.flags = 0;
+                msg.sequence = seq[msg.msg_type]++;
+                const uint64_t intended_ns = rec ? pacer.wait_gap(rec->time_ns) : pacer.wait_next();
+                if (pool) {
+                    while ((msg.payload_slot = pool->acquire()) == PayloadPool::kNone) {
+                        if (producers_stop.load(std::memory_order_relaxed)) return;
+                        ThreadCounters::add(counters.pool_waits, 1);
+                        stall.blocked();
+                        wait.idle([&] {
+                            return producers_stop.load(std::memory_order_relaxed) || pool->can_acquire();
+                        });
+                    }
+                    wait.reset();
+                    msg.payload_bytes = payload_size();
+                    std::memset(pool->data(msg.payload_slot), (uint8_t)msg.sequence, msg.payload_bytes);
+                }
+                msg.timestamp_ns = intended_origin ? intended_ns : clock.now();
+
+                if (fenced[msg.msg_type]) {
+                    fenced[msg.msg_type] = false;
+                    const auto& delivered = delivered_next[order_key(msg)].next;
+                    auto caught_up = [&] {
+                        return seq_diff(delivered.load(std::memory_order_acquire), msg.sequence) >= 0;
+                    };
+                    if (!caught_up()) {
+                        fence_waits.fetch_add(1, std::memory_order_relaxed);
+                        const uint64_t fence_start = clock.now();
+                        while (!caught_up()) {
+                            if (producers_stop.load(std::memory_order_relaxed)) return;
+                            if (clock.now() - fence_start > cfg.reload_fence_timeout_ns) {
+                                fence_timeouts.fetch_add(1, std::memory_order_relaxed);
+                                break;
+                            }
+                            wait.idle([&] { return producers_stop.load(std::memory_order_relaxed) || caught_up(); });
+                        }
+                        wait.reset();
+                    }
+                }
+                int proc_id = routes.fixed_processor(msg.msg_type);
+                if (proc_id < 0) proc_id = balancer.pick(msg.msg_type);
+                // A stage-1 drop gives back the sequence number, so the type's
+                // sequence stays gap-free downstream.
+                auto drop = [&] {
+                    if (pool) pool->release(msg.payload_slot);
+                    --seq[msg.msg_type];
+                    stage1_drops.add(pid, proc_id, 1);
+                    ThreadCounters::add(counters.messages, 1);
+                };
+                if (stage1_overload.policy == OverloadPolicy::Sample) {
+                    if (offered++ % kPressureRefresh == 0)
+                        for (int i = 0; i < routing.processor_count(); ++i)
+                            pressured[i] = stage1.size(i) >= stage1_overload.max_depth;
+                    if (pressured[proc_id] && ++sampled[proc_id] % stage1_overload.sample_every != 0) {
+                        drop();
+                        continue;
+                    }
+                }
+                bool sent = true;
+                auto room = [&] {
+                    return producers_stop.load(std::memory_order_relaxed) ||
+                           stage1.can_push(routing.ingress(), pid, proc_id);
+                };
+                if (inline_payloads) {
+                    // Written once, in place, straight into the lane.
+                    msg.payload_slot = PayloadPool::kNone;
+                    msg.payload_bytes = payloads ? payload_size() : 0;
+                    std::span<uint8_t> record;
+                    while ((record = stage1.reserve(pid, proc_id, msg.payload_bytes)).empty()) {
+                        if (producers_stop.load(std::memory_order_relaxed)) return;
+                        if (stage1_overload.writer_drops()) {
+                            sent = false;
+                            break;
+                        }
+                        stall.blocked();
+                        wait.idle(room);
+                    }
+                    if (sent) {
+                        std::memcpy(record.data(), &msg, sizeof(Message));
+                        std::memset(record.data() + sizeof(Message), (uint8_t)msg.sequence, msg.payload_bytes);
+                        stage1.commit(pid, proc_id, msg.payload_bytes);
+                    }
+                } else {
+                    while (!stage1.push(routing.ingress(), pid, proc_id, msg)) {
+                        if (producers_stop.load(std::memory_order_relaxed)) return;
+                        if (stage1_overload.writer_drops()) {
+                            sent = false;
+                            break;
+                        }
+                        stall.blocked();
+                        wait.idle(room);
+                    }
+                }
+                wait.reset();
+                stall.resumed();
+                if (!sent) {
+                    drop();
+                    continue;
+                }
+                if (park_processors) processor_in_spots[proc_id].notify();
+                ThreadCounters::add(counters.messages, 1);
+                if (intended_origin && intended_ns >= measure_from_ns.load(std::memory_order_relaxed))
+                    send_lag.record(clock.now() - intended_ns);
+            }
+        });
+    }
+
+    // ==========================================================
+    // Monitoring loop
+    // ==========================================================
+    // Ticks every millisecond so burst recovery is resolved finer than the
+    // once-per-second log line.
+    constexpr auto kTick = std::chrono::milliseconds(1);
+    constexpr int kTicksPerSec = 1000;
+    DepthHighWater stage1_hwm(cfg.processor_count), stage2_hwm(cfg.strategy_count);
+    // Samples every queue's depth into the high-water marks; returns the total.
+    auto sample_depths = [&]() {
+        uint64_t depth = 0;
+        for (int i = 0; i < cfg.processor_count; ++i) {
+            uint64_t d = stage1.size(i);
+            stage1_hwm.sample(i, d);
+            depth += d;
+        }
+        for (int i = 0; i < cfg.strategy_count; ++i) {
+            uint64_t d = stage2_queues[i]->size();
+            stage2_hwm.sample(i, d);
+            depth += d;
+        }
+        return depth;
+    };
+    BurstRecoveryTracker recovery(cfg.rate, (uint64_t)cfg.processor_batch * cfg.processor_count +
+                                            (uint64_t)cfg.strategy_batch * cfg.strategy_count);
+
+    if (!pin_current_thread(placement.monitor))
+        std::cerr << "Warning: could not pin monitor to CPU " << placement.monitor << "\n";
+    auto start = std::chrono::steady_clock::now();
+    auto next_tick = start;
+    CounterTotals prev_prod, prev_proc, prev_del;
+    StageLatencies interval;
+    const std::pair<const char*, const LatencyHistogram*> interval_stages[] = {
+        {"stage1", &interval.stage1}, {"process", &interval.processing}, {"stage2", &interval.stage2},
+        {"strategy", &interval.strategy}, {"total", &interval.total}};
+    out.timeline << "t_s,phase,produced,processed,delivered,dropped,stage1_hwm,stage2_hwm";
+    for (auto& [name, h] : interval_stages)
+        out.timeline << "," << name << "_p50_ns," << name << "_p99_ns," << name << "_max_ns";
+    out.timeline << "\n";
+    std::vector<uint64_t> prev_s1_drops(cfg.processor_count, 0), prev_s2_drops(cfg.strategy_count, 0);
+    // Whatever was produced but neither delivered nor dropped is still
+    // queued or in a thread's hands. The counters are read one by one, so
+    // a live reading can be off by the traffic of the read itself.
+    auto in_flight = [](uint64_t produced, uint64_t delivered, uint64_t dropped) {
+        return (int64_t)(produced - delivered - dropped);
+    };
+    auto delta = [](const std::vector<uint64_t>& now, std::vector<uint64_t>& prev) {
+        std::vector<uint64_t> d(now.size());
+        for (size_t i = 0; i < now.size(); ++i) d[i] = now[i] - prev[i];
+        prev = now;
+        return d;
+    };
+    auto list = [](const std::vector<uint64_t>& v) {
+        std::ostringstream out;
+        out << "[";
+        for (size_t i = 0; i < v.size(); ++i) out << (i ? ", " : "") << v[i];
+        out << "]";
+        return out.str();
+    };
+    // Totals at the start of the measure window; the summary reports the
+    // difference. backlog_at_start is what was in flight at that point.
+    CounterTotals base_prod, base_proc, base_del;
+    std::vector<uint64_t> base_s1_drops(cfg.processor_count, 0), base_s2_drops(cfg.strategy_count, 0);
+    int64_t backlog_at_start = 0;
+    auto set_perf = [&](bool on) {
+        for (auto* role : {&producer_perf, &processor_perf, &strategy_perf})
+            for (auto& c : *role) on ? c->enable() : c->disable();
+    };
+    perf_opened.wait();
+    if (cfg.warmup_secs == 0) set_perf(true);
+
+    // routing_reload: every kReloadPollTicks the monitor checks for SIGHUP or
+    // a new mtime on the config file, rereads it and publishes its stage-1
+    // and stage-2 rules as the next epoch. Each epoch records the per-thread
+    // counters at its start, so the summary can show how traffic moved.
+    constexpr int kReloadPollTicks = 100;
+    struct EpochRecord {
+        uint32_t epoch;
+        std::string trigger;
+        uint64_t start_ns;       // since run start
+        int64_t adopted_ns;      // until every producer and processor routed with it; -1 if never
+        std::vector<uint64_t> processed, delivered;
+        uint64_t fence_waits, fence_timeouts;
+    };
+    std::vector<EpochRecord> epochs;
+    auto per_thread = [](const std::vector<ThreadCounters>& threads) {
+        std::vector<uint64_t> v;
+        for (auto& c : threads) v.push_back(c.messages.load(std::memory_order_relaxed));
+        return v;
+    };
+    auto open_epoch = [&](uint32_t epoch, std::string trigger) {
+        epochs.push_back({epoch, std::move(trigger), now_ns() - run_start_ns, -1, per_thread(processor_counters),
+                          per_thread(strategy_counters), fence_waits.load(), fence_timeouts.load()});
+    };
+    const bool reload = cfg.routing_reload && tables;
+    std::error_code mtime_error;
+    auto config_mtime = std::filesystem::last_write_time(cfg.path, mtime_error);
+    void (*previous_sighup)(int) = SIG_DFL;
+    if (reload) {
+        open_epoch(0, "start");
+        epochs[0].adopted_ns = 0;
+        reload_requested = false;
+        previous_sighup = std::signal(SIGHUP, request_reload);
+    }
+    auto reload_note = [&](const std::string& text) {
+        std::ostringstream line;
+        line << "[" << std::fixed << std::setprecision(2) << (now_ns() - run_start_ns) / 1e9 << "s] " << text;
+        std::cout << line.str() << std::endl;
+        log_file << line.str() << "\n";
+    };
+    auto try_reload = [&](const std::string& trigger) {
+        Config next;
+        try {
+            next = load_config(cfg.path);
+        } catch (const std::exception& e) {
+            reload_note("Routing reload (" + trigger + ") failed: " + e.what());
+            return;
+        }
+        std::string why = reload_conflict(cfg, next);
+        if (!why.empty()) {
+            reload_note("Routing reload (" + trigger + ") rejected: " + why + " cannot change while running");
+            return;
+        }
+        const RoutingTable& current = *tables->current();
+        auto table = std::make_unique<RoutingTable>(next, current.epoch + 1);
+        if (table->same_routes(current)) {
+            reload_note("Routing reload (" + trigger + "): rules unchanged");
+            return;
+        }
+        open_epoch(table->epoch, trigger);
+        reload_note("Routing epoch " + std::to_string(table->epoch) + " published (" + trigger + ")");
+        tables->publish(std::move(table));
+        for (auto& spot : processor_in_spots) spot.wake();
+    };
+    auto poll_reload = [&] {
+        if (reload_requested.exchange(false)) try_reload("signal");
+        auto mtime = std::filesystem::last_write_time(cfg.path, mtime_error);
+        if (!mtime_error && mtime != config_mtime) {
+            config_mtime = mtime;
+            try_reload("file");
+        }
+    };
+    // Runs every tick while the latest epoch has not been adopted everywhere.
+    auto track_adoption = [&] {
+        if (epochs.back().adopted_ns >= 0) return;
+        uint32_t oldest = UINT32_MAX;
+        for (auto* role : {&producer_counters, &processor_counters})
+            for (auto& c : *role) oldest = std::min<uint32_t>(oldest, c.epoch.load(std::memory_order_acquire));
+        for (auto& e : epochs)
+            if (e.adopted_ns < 0 && oldest >= e.epoch)
+                e.adopted_ns = (int64_t)(now_ns() - run_start_ns - e.start_ns);
+        tables->reclaim(oldest);
+    };
+
+    for (int sec = 1; sec <= cfg.warmup_secs + cfg.duration_secs; ++sec) {
+        const bool warming_up = sec <= cfg.warmup_secs;
+        for (int t = 0; t < kTicksPerSec; ++t) {
+            next_tick += kTick;
+            std::this_thread::sleep_until(next_tick);
+            uint64_t depth = sample_depths();
+            if (cfg.rate.bursty() && !warming_up)
+                recovery.sample(now_ns() - run_start_ns, depth);
+            if (reload) {
+                if (t % kReloadPollTicks == 0) poll_reload();
+                track_adoption();
+            }
+        }
+        // Delivered and dropped are read before produced so in-flight does
+        // not count messages produced after the other reads.
+        CounterTotals d = CounterTotals::sum(strategy_counters);
+        std::vector<uint64_t> s1_drops_total = stage1_drops.per_queue(), s2_drops_total = stage2_drops.per_queue();
+        CounterTotals r = CounterTotals::sum(processor_counters);
+        CounterTotals p = CounterTotals::sum(producer_counters);
+        CounterTotals dp = p - prev_prod, dr = r - prev_proc, dd = d - prev_del;
+        uint64_t dropped_total = 0;
+        for (auto* v : {&s1_drops_total, &s2_drops_total})
+            for (uint64_t x : *v) dropped_total += x;
+        std::vector<uint64_t> s1_drops = delta(s1_drops_total, prev_s1_drops);
+        std::vector<uint64_t> s2_drops = delta(s2_drops_total, prev_s2_drops);
+        uint64_t dropped_now = 0;
+        for (auto* v : {&s1_drops, &s2_drops})
+            for (uint64_t x : *v) dropped_now += x;
+
+        double produced_m = dp.messages / 1e6;
+        double processed_m = dr.messages / 1e6;
+        double delivered_m = dd.messages / 1e6;
+        double dropped_m = dropped_now / 1e6;
+
+        prev_prod = p;
+        prev_proc = r;
+        prev_del = d;
+
+        std::vector<uint64_t> s1_depth, s2_depth;
+        for (int i = 0; i < cfg.processor_count; ++i) s1_depth.push_back(stage1.size(i));
+        for (auto& q : stage2_queues) s2_depth.push_back(q->size());
+        std::vector<uint64_t> s1_hwm = stage1_hwm.roll(), s2_hwm = stage2_hwm.roll();
+
+        interval.reset();
+        for (auto& l : strategy_latencies) {
+            StageLatencies& done = l->rotate();
+            interval.merge(done);
+            done.reset();
+        }
+        latencies.merge(interval);
+
+        std::ostringstream line;
+        line << "[" << std::fixed << std::setprecision(2) << (double)sec << "s" << (warming_up ? " warmup" : "")
+             << "] Produced: " << produced_m << "M | "
+             << "Processed: " << processed_m << "M | "
+             << "Delivered: " << delivered_m << "M | "
+             << "Dropped: " << dropped_m << "M | "
+             << "In flight: " << in_flight(p.messages, d.messages, dropped_total) << " | "
+             << "Stage1 Queues: " << list(s1_depth) << " HWM " << list(s1_hwm)
+             << " | Stage2 Queues: " << list(s2_depth) << " HWM " << list(s2_hwm)
+             << " | Full waits P/R: " << dp.full_waits << "/" << dr.full_waits
+             << " | Empty waits R/S: " << dr.empty_waits << "/" << dd.empty_waits
+             << " | Stall ms P/R: " << dp.stall_ns / 1e6 << "/" << dr.stall_ns / 1e6
+             << " | Latency us p50/p99/max";
+        for (auto& [name, h] : interval_stages)
+            line << " " << name << " " << h->percentile(0.50) / 1000.0 << "/" << h->percentile(0.99) / 1000.0
+                 << "/" << h->max() / 1000.0;
+        if (warming_up) line << " (not recorded)";
+
+        std::cout << line.str() << std::endl;
+        log_file << line.str() << "\n";
+
+        out.timeline << sec << "," << (warming_up ? "warmup" : "measure") << "," << dp.messages << "," << dr.messages << "," << dd.messages << "," << dropped_now
+                     << "," << std::ranges::max(s1_hwm) << "," << std::ranges::max(s2_hwm);
+        for (auto& [name, h] : interval_stages)
+            out.timeline << "," << h->percentile(0.50) << "," << h->percentile(0.99) << "," << h->max();
+        out.timeline << "\n";
+        out.timeline.flush();
+
+        if (metrics_file.is_open()) {
+            nlohmann::ordered_json rec = {
+                {"t", sec},
+                {"phase", warming_up ? "warmup" : "measure"},
+                {"produced", dp.messages}, {"processed", dr.messages}, {"delivered", dd.messages},
+                {"dropped", dropped_now}, {"in_flight", in_flight(p.messages, d.messages, dropped_total)},
+                {"stage1_depth", s1_depth}, {"stage1_hwm", s1_hwm}, {"stage1_drops", s1_drops},
+                {"stage2_depth", s2_depth}, {"stage2_hwm", s2_hwm}, {"stage2_drops", s2_drops},
+                {"producers", {{"full_waits", dp.full_waits}, {"pool_waits", dp.pool_waits},
+                               {"stall_ns", dp.stall_ns}}},
+                {"processors", {{"full_waits", dr.full_waits}, {"empty_waits", dr.empty_waits},
+                                {"stall_ns", dr.stall_ns}}},
+                {"strategies", {{"empty_waits", dd.empty_waits}}},
+            };
+            for (auto& [name, h] : interval_stages)
+                rec["latency_ns"][name] = {{"p50", h->percentile(0.50)}, {"p99", h->percentile(0.99)},
+                                           {"max", h->max()}};
+            metrics_file << rec.dump() << "\n";
+            metrics_file.flush();
+        }
+
+        if (sec == cfg.warmup_secs) {
+            measure_from_ns.store(clock.now(), std::memory_order_relaxed);
+            base_prod = p;
+            base_proc = r;
+            base_del = d;
+            base_s1_drops = s1_drops_total;
+            base_s2_drops = s2_drops_total;
+            backlog_at_start = in_flight(p.messages, d.messages, dropped_total);
+            stage1_hwm.reset_run();
+            stage2_hwm.reset_run();
+            set_perf(true);
+        }
+    }
+    // Hardware counters cover the measure window, not the drain.
+    set_perf(false);
+    if (reload) std::signal(SIGHUP, previous_sighup);
+    const CounterTotals window_prod = CounterTotals::sum(producer_counters) - base_prod;
+    const CounterTotals window_proc = CounterTotals::sum(processor_counters) - base_proc;
+    const CounterTotals window_del = CounterTotals::sum(strategy_counters) - base_del;
+
+    // Stop producers, then let each stage empty before it is stopped, so
+    // nothing from the measure window is left in the queues.
+    auto wake_all = [&](std::initializer_list<std::vector<ParkingSpot>*> groups) {
+        for (auto* spots : groups)
+            for (auto& spot : *spots) spot.wake();
+    };
+    producers_stop = true;
+    wake_all({&producer_spots});
+    uint64_t producer_cpu_ns = 0, processor_cpu_ns = 0, strategy_cpu_ns = 0;
+    for (int i = 0; i < cfg.producer_count; ++i) producer_cpu_ns += workers.wait(producer_slot + i);
+
+    const uint64_t drain_start_ns = now_ns();
+    auto await_exit = [&](std::atomic<int>& exited, int count) {
+        while (exited.load(std::memory_order_acquire) < count && now_ns() - drain_start_ns < cfg.drain_timeout_ns)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        return exited.load(std::memory_order_acquire) == count;
+    };
+    producers_done.store(true, std::memory_order_release);
+    wake_all({&processor_in_spots, &processor_out_spots});
+    bool drained = await_exit(processors_exited, cfg.processor_count);
+    if (drained) {
+        processors_done.store(true, std::memory_order_release);
+        wake_all({&strategy_spots});
+        drained = await_exit(strategies_exited, cfg.strategy_count);
+    }
+    if (!drained) {
+        std::cerr << "Warning: drain did not finish within " << cfg.drain_timeout_ns / 1000000
+                  << " ms; stopping with messages still queued\n";
+        stop_flag = true;
+        wake_all({&processor_in_spots, &processor_out_spots, &strategy_spots});
+    }
+    for (int i = 0; i < cfg.processor_count; ++i) processor_cpu_ns += workers.wait(processor_slot + i);
+    for (int i = 0; i < cfg.strategy_count; ++i) strategy_cpu_ns += workers.wait(strategy_slot + i);
+    const uint64_t drain_ns = now_ns() - drain_start_ns;
+    const uint64_t captured = capture ? capture->finish() : 0;
+
+    // ==========================================================
+    // Summary
+    // ==========================================================
+    summary_file << "=== PERFORMANCE SUMMARY ===\n";
+    summary_file << "Scenario: " << scenario << "\n";
+    summary_file << "Stage1 ingress: " << ingress_topology_name(cfg.stage1_ingress) << "\n";
+    summary_file << "Routing: " << (Routing::is_static ? "static" : "dynamic") << "\n";
+    summary_file << "Clock: " << clock_source_name(clock.source()) << " | Message: " << sizeof(Message) << " bytes\n";
+    summary_file << "Latency origin: " << (intended_origin ? "intended" : "send");
+    if (co_interval_ns) summary_file << " | CO correction: expected interval " << co_interval_ns << " ns";
+    summary_file << "\n";
+    summary_file << "Queues: stage1 " << cfg.stage1_capacity << " | stage2 " << cfg.stage2_capacity
+                 << " slots | huge pages: " << huge_pages_name(cfg.huge_pages);
+    if (int fallbacks = hugetlb_fallbacks.load() - fallbacks_before)
+        summary_file << " (" << fallbacks << " rings fell back to transparent)";
+    summary_file << " | prefault: " << (cfg.prefault_queues ? "on" : "off") << "\n";
+    if (trace)
+        summary_file << "Replay: " << trace->path() << " | " << trace->records().size() << " records in "
+                     << trace->streams().size() << " producer streams\n";
+    if (capture)
+        summary_file << "Capture: " << capture->path() << " | " << captured << " records | "
+                     << capture->dropped() << " dropped (file full)\n";
+    if (placement.numa != NumaPolicy::None || placement.monitor >= 0 || !placement.producers.empty() ||
+        !placement.processors.empty() || !placement.strategies.empty()) {
+        auto cores = [](const std::vector<int>& v) {
+            std::string out;
+            for (int c : v) out += (out.empty() ? "" : ",") + std::to_string(c);
+            return out.empty() ? std::string("-") : out;
+        };
+        static const char* numa_names[] = {"none", "first_touch", "mbind"};
+        summary_file << "Placement: producers=" << cores(placement.producers)
+                     << " processors=" << cores(placement.processors)
+                     << " strategies=" << cores(placement.strategies)
+                     << " monitor=" << (placement.monitor >= 0 ? std::to_string(placement.monitor) : "-")
+                     << " numa=" << numa_names[(int)placement.numa] << "\n";
+    }
+    summary_file << "Duration: " << cfg.duration_secs << " seconds measured";
+    if (cfg.warmup_secs) summary_file << " after " << cfg.warmup_secs << " s warm-up";
+    summary_file << " | drain " << drain_ns / 1e6 << " ms" << (drained ? "" : " (timed out)") << "\n";
+    // Counts cover the measure window and the drain that follows it.
+    const CounterTotals produced = CounterTotals::sum(producer_counters) - base_prod;
+    const CounterTotals processed = CounterTotals::sum(processor_counters) - base_proc;
+    const CounterTotals delivered = CounterTotals::sum(strategy_counters) - base_del;
+    const std::vector<uint64_t> stage1_window_drops = delta(stage1_drops.per_queue(), base_s1_drops);
+    const std::vector<uint64_t> stage2_window_drops = delta(stage2_drops.per_queue(), base_s2_drops);
+    summary_file << "Produced:  " << produced.messages << "\n";
+    summary_file << "Processed: " << processed.messages << "\n";
+    summary_file << "Delivered: " << delivered.messages << "\n";
+    const uint64_t stage1_dropped = std::reduce(stage1_window_drops.begin(), stage1_window_drops.end(), uint64_t(0));
+    const uint64_t stage2_dropped = std::reduce(stage2_window_drops.begin(), stage2_window_drops.end(), uint64_t(0));
+    summary_file << "Dropped:   " << stage1_dropped + stage2_dropped << " (stage1 " << stage1_dropped
+                 << ", stage2 " << stage2_dropped << ")\n";
+    summary_file << "Abandoned: "
+                 << backlog_at_start + in_flight(produced.messages, delivered.messages, stage1_dropped + stage2_dropped)
+                 << " (queued or in hand at shutdown)\n";
+    summary_file << "CPU time:  producers " << producer_cpu_ns / 1e9 << " s | processors " << processor_cpu_ns / 1e9
+                 << " s | strategies " << strategy_cpu_ns / 1e9 << " s\n";
+
+    for (auto& l : strategy_latencies)
+        for (int i = 0; i < 2; ++i) latencies.merge(l->buffer(i));
+
+    write_stage_percentiles(summary_file, latencies);
+    if (co_interval_ns) {
+        LatencyHistogram corrected;
+        corrected.merge_corrected(latencies.total, co_interval_ns);
+        write_percentile_row(summary_file, "Total CO ", corrected);
+    }
+    if (intended_origin) {
+        LatencyHistogram lag;
+        for (auto& h : send_lags) lag.merge(*h);
+        write_percentile_row(summary_file, "Send lag ", lag);
+    }
+    if (work_stealing) write_percentile_row(summary_file, "Stolen   ", latencies.stolen_total);
+
+    recovery.write_summary(summary_file);
+
+    summary_file << "\nBackpressure:\n";
+    summary_file << "Stage1 HWM: " << list(stage1_hwm.run())
+                 << " | Stage2 HWM: " << list(stage2_hwm.run()) << " (sampled every ms)\n";
+    summary_file << "Producers  | Full waits: " << produced.full_waits
+                 << " | Stalled: " << produced.stall_ns / 1e6 << " ms\n";
+    summary_file << "Processors | Full waits: " << processed.full_waits
+                 << " | Stalled: " << processed.stall_ns / 1e6 << " ms"
+                 << " | Empty waits: " << processed.empty_waits << "\n";
+    summary_file << "Strategies | Empty waits: " << delivered.empty_waits << "\n";
+
+    // Per-message counts of one role over the measure window; events no
+    // thread of the role could open are left out.
+    auto role_perf = [](const std::vector<std::unique_ptr<PerfCounters>>& role, uint64_t messages) {
+        nlohmann::ordered_json out = nlohmann::ordered_json::object();
+        for (int e = 0; e < PerfCounters::kEvents && messages; ++e) {
+            uint64_t sum = 0;
+            bool seen = false;
+            for (auto& c : role) {
+                if (!c->available((PerfCounters::Event)e)) continue;
+                seen = true;
+                sum += c->value((PerfCounters::Event)e);
+            }
+            if (seen) out[PerfCounters::kNames[e]] = (double)sum / messages;
+        }
+        if (out.contains("cycles") && out.contains("instructions") && out["cycles"].get<double>() > 0)
+            out["ipc"] = out["instructions"].get<double>() / out["cycles"].get<double>();
+        return out;
+    };
+    nlohmann::ordered_json hw_counters;
+    if (cfg.perf_counters) {
+        hw_counters = {{"producers", role_perf(producer_perf, window_prod.messages)},
+                       {"processors", role_perf(processor_perf, window_proc.messages)},
+                       {"strategies", role_perf(strategy_perf, window_del.messages)}};
+        // Every refusal, by role: events refused with the same error by the
+        // same number of the role's threads share a line.
+        nlohmann::ordered_json unavailable = nlohmann::ordered_json::object();
+        std::vector<std::string> refusals;
+        const std::pair<const char*, const std::vector<std::unique_ptr<PerfCounters>>*> roles[] = {
+            {"producers", &producer_perf}, {"processors", &processor_perf}, {"strategies", &strategy_perf}};
+        for (auto& [name, role] : roles) {
+            struct Refusal {
+                std::string error;
+                int threads;
+                std::vector<std::string> events;
+            };
+            std::vector<Refusal> found;
+            for (int e = 0; e < PerfCounters::kEvents; ++e) {
+                std::vector<std::pair<std::string, int>> errors; // error, threads
+                for (auto& c : *role) {
+                    const std::string& why = c->error((PerfCounters::Event)e);
+                    if (why.empty()) continue;
+                    auto it = std::find_if(errors.begin(), errors.end(), [&](auto& p) { return p.first == why; });
+                    if (it == errors.end()) errors.push_back({why, 1});
+                    else ++it->second;
+                }
+                for (auto& [why, threads] : errors) {
+                    auto it = std::find_if(found.begin(), found.end(),
+                                           [&](auto& r) { return r.error == why && r.threads == threads; });
+                    if (it == found.end()) found.push_back({why, threads, {PerfCounters::kNames[e]}});
+                    else it->events.push_back(PerfCounters::kNames[e]);
+                }
+            }
+            for (auto& r : found) {
+                std::string events;
+                for (auto& e : r.events) events += (events.empty() ? "" : ", ") + e;
+                refusals.push_back(std::string(name) + " | " + events + ": " + r.error + " (" +
+                                   std::to_string(r.threads) + "/" + std::to_string(role->size()) + " threads)");
+                unavailable[name].push_back({{"events", r.events}, {"error", r.error}, {"threads", r.threads}});
+            }
+        }
+        summary_file << "\nHardware counters (per message, measure window):\n";
+        if (refusals.size()) {
+            summary_file << "Unavailable events:\n";
+            for (auto& line : refusals) summary_file << "  " << line << "\n";
+        }
+        for (auto role = hw_counters.begin(); role != hw_counters.end(); ++role) {
+            summary_file << std::setw(10) << std::left << role.key() << std::right;
+            if (role->empty()) summary_file << " | none";
+            for (auto e = role->begin(); e != role->end(); ++e)
+                summary_file << " | " << e.key() << " " << e->get<double>();
+            summary_file << "\n";
+        }
+        hw_counters["unavailable"] = unavailable;
+    }
+
+    auto write_overload = [&](const char* stage, const OverloadConfig& o, const std::vector<uint64_t>& drops) {
+        summary_file << stage << " " << overload_policy_name(o.policy);
+        if (o.policy == OverloadPolicy::DropOldest || o.policy == OverloadPolicy::Sample)
+            summary_file << " (max depth " << o.max_depth << ")";
+        if (o.policy == OverloadPolicy::Sample)
+            summary_file << " (1 in " << o.sample_every << ")";
+        summary_file << " | Drops: " << list(drops) << "\n";
+    };
+    summary_file << "\nOverload:\n";
+    write_overload("Stage1", stage1_overload, stage1_window_drops);
+    write_overload("Stage2", stage2_overload, stage2_window_drops);
+
+    if (work_stealing) {
+        summary_file << "\nWork Stealing:\n";
+        for (int i = 0; i < cfg.processor_count; ++i)
+            summary_file << "Processor " << i << " | Steals: " << steal_stats[i].steals
+                         << " | Stolen msgs: " << steal_stats[i].stolen << "\n";
+    }
+
+    if (payloads) {
+        uint64_t waits = produced.pool_waits, bytes = 0, sum = 0;
+        for (auto* stats : {&processor_payloads, &strategy_payloads})
+            for (auto& p : *stats) {
+                bytes += p.bytes;
+                sum += p.checksum;
+            }
+        summary_file << "\nPayloads: " << cfg.payload_min_bytes << "-" << cfg.payload_max_bytes << " bytes";
+        if (pooled_payloads)
+            summary_file << " | Pool: " << cfg.payload_pool_slots << " x " << payload_pools[0]->slot_bytes()
+                         << " bytes per producer | Pool waits: " << waits;
+        else
+            summary_file << " | Inline in " << BYTE_RING_SIZE << "-byte rings";
+        summary_file << " | Bytes read: " << bytes << " | Checksum: " << std::hex << sum << std::dec << "\n";
+    }
+
+    summary_file << "\nOrdering (mode: " << ordering_mode_name(cfg.ordering_mode) << "):\n";
+    for (int sid = 0; sid < cfg.strategy_count; ++sid) {
+        summary_file << "Strategy " << sid
+                     << " | Out-of-order: " << order_checkers[sid]->violations()
+                     << " | Reordered: " << reorder_buffers[sid]->reordered()
+                     << " | Gaps skipped: " << reorder_buffers[sid]->skipped() << " ("
+                     << reorder_buffers[sid]->expired() << " after max hold)"
+                     << " | Longest hold: " << reorder_buffers[sid]->longest_hold_ns() / 1000.0 << " us"
+                     << " | Late: " << reorder_buffers[sid]->late() << "\n";
+        if (reorder_buffers[sid]->longest_hold_ns() > 2 * cfg.reorder_max_hold_ns)
+            std::cerr << "Warning: strategy " << sid << " held a gap for "
+                      << reorder_buffers[sid]->longest_hold_ns() / 1000 << " us, over twice reorder_max_hold_us\n";
+    }
+
+    // Handler counts cover every delivered message, warm-up and drain included.
+    summary_file << "\nStrategy handler (mode: " << strategy_mode_name(cfg.strategy_mode);
+    if (batched_strategies)
+        summary_file << ", coalesce " << cfg.coalesce_max << " msgs / " << cfg.coalesce_max_wait_ns / 1000.0 << " us";
+    summary_file << ", handler " << (cfg.strategy_aggregates ? "aggregate" : "busy");
+    if (cfg.strategy_aggregates && batched_strategies) summary_file << ", kernel " << aggregate_kernel_name();
+    summary_file << "):\n";
+    nlohmann::ordered_json strategy_handler = nlohmann::ordered_json::array();
+    TypeAggregates all_types;
+    const std::vector<uint64_t> handled = per_thread(strategy_counters);
+    for (int sid = 0; sid < cfg.strategy_count; ++sid) {
+        const HandlerStats& h = *handler_stats[sid];
+        const uint64_t msgs = handled[sid];
+        const uint64_t calls = batched_strategies ? h.calls : msgs;
+        all_types.merge(h.aggregates);
+        summary_file << "Strategy " << sid << " | Calls: " << calls << " | Msgs/call: "
+                     << (calls ? (double)msgs / calls : 0.0);
+        if (batched_strategies)
+            summary_file << " | Coalesce wait p50/p99/max: " << h.coalesce_wait.percentile(0.50) / 1000.0 << "/"
+                         << h.coalesce_wait.percentile(0.99) / 1000.0 << "/" << h.coalesce_wait.max() / 1000.0 << " us";
+        summary_file << "\n";
+        strategy_handler.push_back({{"calls", calls}, {"messages", msgs},
+                                    {"coalesce_wait_us", batched_strategies ? nlohmann::ordered_json{
+                                        {"p50", h.coalesce_wait.percentile(0.50) / 1000.0},
+                                        {"p99", h.coalesce_wait.percentile(0.99) / 1000.0},
+                                        {"max", h.coalesce_wait.max() / 1000.0}} : nlohmann::ordered_json()}});
+    }
+    if (cfg.strategy_aggregates) {
+        summary_file << "Per type (messages, mean send-to-done us):";
+        for (int t = 0; t < MAX_MSG_TYPES; ++t)
+            if (all_types.count[t])
+                summary_file << " " << t << ": " << all_types.count[t] << ", "
+                             << all_types.latency_ns[t] / 1000.0 / all_types.count[t];
+        summary_file << "\n";
+    }
+
+    // Each epoch runs until the next one starts; the last one until the end
+    // of the drain. Counts include warm-up and drain.
+    nlohmann::ordered_json routing_epochs;
+    if (reload) {
+        summary_file << "\nRouting epochs:\n";
+        routing_epochs = nlohmann::ordered_json::array();
+        const std::vector<uint64_t> processed_end = per_thread(processor_counters);
+        const std::vector<uint64_t> delivered_end = per_thread(strategy_counters);
+        for (size_t i = 0; i < epochs.size(); ++i) {
+            const EpochRecord& e = epochs[i];
+            const bool last = i + 1 == epochs.size();
+            std::vector<uint64_t> processed = processed_end, delivered = delivered_end;
+            uint64_t waits = fence_waits.load(), timeouts = fence_timeouts.load();
+            if (!last) {
+                processed = epochs[i + 1].processed;
+                delivered = epochs[i + 1].delivered;
+                waits = epochs[i + 1].fence_waits;
+                timeouts = epochs[i + 1].fence_timeouts;
+            }
+            for (size_t k = 0; k < processed.size(); ++k) processed[k] -= e.processed[k];
+            for (size_t k = 0; k < delivered.size(); ++k) delivered[k] -= e.delivered[k];
+            waits -= e.fence_waits;
+            timeouts -= e.fence_timeouts;
+            std::ostringstream adopted;
+            adopted << std::fixed << std::setprecision(3) << e.adopted_ns / 1e6 << " ms";
+            summary_file << "Epoch " << e.epoch << " (" << e.trigger << ") | from " << std::fixed << std::setprecision(2)
+                         << e.start_ns / 1e9 << " s" << std::defaultfloat
+                         << " | Adopted in: " << (e.adopted_ns < 0 ? "-" : adopted.str())
+                         << " | Processed: " << list(processed) << " | Delivered: " << list(delivered)
+                         << " | Ordered-type fence waits: " << waits << " (" << timeouts << " timed out)\n";
+            routing_epochs.push_back({{"epoch", e.epoch}, {"trigger", e.trigger}, {"start_s", e.start_ns / 1e9},
+                                      {"adopted_ms", e.adopted_ns < 0 ? nlohmann::ordered_json() : nlohmann::ordered_json(e.adopted_ns / 1e6)},
+                                      {"processed", processed}, {"delivered", delivered},
+                                      {"fence_waits", waits}, {"fence_timeouts", timeouts}});
+        }
+    }
+
+    std::cout << "Scenario " << scenario << " complete. Results written to "
+              << out.summary_path << std::endl;
+
+    uint64_t out_of_order = 0;
+    for (auto& c : order_checkers) out_of_order += c->violations();
+    const double measured_secs = cfg.duration_secs > 0 ? (double)cfg.duration_secs : 1.0;
+    return {
+        {"scenario", scenario},
+        {"routing", Routing::is_static ? "static" : "dynamic"},
+        {"stage1_ingress", ingress_topology_name(cfg.stage1_ingress)},
+        {"duration_s", cfg.duration_secs},
+        {"warmup_s", cfg.warmup_secs},
+        {"drain_ms", drain_ns / 1e6},
+        {"drained", drained},
+        {"produced", produced.messages},
+        {"processed", processed.messages},
+        {"delivered", delivered.messages},
+        {"throughput_msgs_per_s", delivered.messages / measured_secs},
+        {"dropped", {{"stage1", stage1_dropped}, {"stage2", stage2_dropped}}},
+        {"abandoned", backlog_at_start + in_flight(produced.messages, delivered.messages, stage1_dropped + stage2_dropped)},
+        {"latency_us", stage_percentiles_json(latencies)},
+        {"cpu_s",
+         {{"producers", producer_cpu_ns / 1e9}, {"processors", processor_cpu_ns / 1e9},
+          {"strategies", strategy_cpu_ns / 1e9}}},
+        {"out_of_order", out_of_order},
+        {"hw_counters", hw_counters},
+        {"strategy_handler", {{"mode", strategy_mode_name(cfg.strategy_mode)}, {"strategies", strategy_handler}}},
+        {"routing_epochs", routing_epochs},
+        {"trace_capture", capture ? nlohmann::ordered_json{{"file", capture->path()}, {"records", captured},
+                                                           {"dropped", capture->dropped()}}
+                                  : nlohmann::ordered_json()},
+    };
+}
+
+// Picks the compiled topology when it matches cfg, else dynamic routing.
+// routing_reload always takes the dynamic tables, which can be swapped.
+static nlohmann::ordered_json run_config(const Config& cfg, const std::string& scenario, ScenarioOutputs& out,
+                                         WorkerPool& workers) {
+#if defined(ROUTER_STATIC_TOPOLOGY)
+    std::string mismatch;
+    if (cfg.routing_reload)
+        std::cerr << "Note: routing_reload is set; using dynamic routing instead of the compiled topology\n";
+    else if (StaticRouting<GeneratedTopology>::matches(cfg, mismatch))
+        return run_scenario(cfg, StaticRouting<GeneratedTopology>{}, scenario, out, workers, nullptr);
+    else
+        std::cerr << "Warning: config differs from the compiled topology (" << GeneratedTopology::source
+                  << ") in " << mismatch << "; using dynamic routing\n";
+#endif
+    RoutingTables tables(cfg);
+    return run_scenario(cfg, DynamicRouting(cfg, tables), scenario, out, workers, &tables);
+}
+
+// ==========================================================
+// Multi-Process Deployment
+// ==========================================================
+// router --role producer|processor|strategy [--index N] <config> <results_dir>
+// runs one stage as its own process: every thread of the role, or only
+// thread N. Stages meet in the named segment shared_memory.name (default
+// /router_<scenario>): a control block, then a producer x processor matrix
+// of stage-1 rings and a processor x strategy matrix of stage-2 rings, the
+// lanes layout of the in-process pipeline. Messages are written into the
+// shared slots directly, so the path is the same lock-free SPSC handoff.
+//
+// Whichever process comes first creates and lays out the segment. The run
+// starts once every thread of every role has attached and ends like the
+// in-process one: producers stop after warm-up plus duration, and each
+// stage exits once its upstream has finished and its rings are empty. An
+// upstream process that dies counts as finished, so the rest still drain
+// and report; the last process out unlinks the segment. Timestamps compare
+// across processes because every clock source maps onto CLOCK_MONOTONIC.
+enum class ShmRole { Producer, Processor, Strategy };
+constexpr int SHM_ROLES = 3;
+constexpr int SHM_MAX_THREADS = 256; // producer_id is one byte
+constexpr uint64_t SHM_MAGIC = 0x314d48535452ull; // "RTSHM1"
+constexpr size_t SHM_PAGE = 4096;
+
+static ShmRole parse_shm_role(const std::string& name) {
+    if (name == "producer") return ShmRole::Producer;
+    if (name == "processor") return ShmRole::Processor;
+    if (name == "strategy") return ShmRole::Strategy;
+    throw std::runtime_error("Unknown role: " + name + " (producer, processor or strategy)");
+}
+
+static const char* shm_role_name(ShmRole role) {
+    switch (role) {
+        case ShmRole::Producer: return "producer";
+        case ShmRole::Processor: return "processor";
+        case ShmRole::Strategy: return "strategy";
+    }
+    return "?";
+}
+
+// Why cfg cannot be deployed over shared memory; empty if it can. Features
+// that share more than the rings between stages stay in-process only.
+static std::string shm_unsupported(const Config& cfg) {
+    if (cfg.producer_count > SHM_MAX_THREADS || cfg.processor_count > SHM_MAX_THREADS ||
+        cfg.strategy_count > SHM_MAX_THREADS)
+        return "more than " + std::to_string(SHM_MAX_THREADS) + " threads in a role";
+    if (cfg.payload_max_bytes) return "payloads (payload pools are process-local)";
+    if (cfg.processor_mode == ProcessorMode::WorkStealing) return "processors.mode work_stealing";
+    if (cfg.ordering_mode == OrderingMode::Reorder) return "ordering_mode reorder";
+    if (cfg.strategy_mode == StrategyMode::Batched) return "strategies.mode batched";
+    if (cfg.strategy_aggregates) return "strategies.handler aggregate";
+    if (cfg.routing_reload) return "routing_reload";
+    if (cfg.type_source == TypeSource::Trace || cfg.capture_trace) return "trace replay and capture";
+    if (cfg.stage1_overload.policy != OverloadPolicy::Block || cfg.stage2_overload.policy != OverloadPolicy::Block)
+        return "overload policies other than block";
+    return "";
+}
+
+// finished is set by the thread itself once its last message is published;
+// pid is the process that attached the thread (0: not yet).
+struct ShmControl {
+    std::atomic<uint64_t> magic; // stored last by the creator
+    uint64_t layout_hash;
+    std::atomic<uint64_t> start_ns;
+    std::atomic<int32_t> processes; // mapped right now
+    std::atomic<int32_t> attached[SHM_ROLES];
+    std::atomic<int32_t> pid[SHM_ROLES][SHM_MAX_THREADS];
+    std::atomic<uint8_t> finished[SHM_ROLES][SHM_MAX_THREADS];
+};
+
+// Offsets of everything in the segment; every ring starts on its own page.
+struct ShmLayout {
+    size_t stage1_offset, stage1_stride;
+    size_t stage2_offset, stage2_stride;
+    size_t bytes;
+    uint64_t hash;
+    int processors, strategies;
+
+    explicit ShmLayout(const Config& cfg) : processors(cfg.processor_count), strategies(cfg.strategy_count) {
+        auto pages = [](size_t n) { return (n + SHM_PAGE - 1) / SHM_PAGE * SHM_PAGE; };
+        const size_t header = pages(sizeof(ShmRingHeader));
+        stage1_offset = pages(sizeof(ShmControl));
+        stage1_stride = header + pages(ShmSPSCQueue<Message>::slot_bytes(cfg.stage1_capacity));
+        stage2_offset = stage1_offset + (size_t)cfg.producer_count * cfg.processor_count * stage1_stride;
+        stage2_stride = header + pages(ShmSPSCQueue<Message>::slot_bytes(cfg.stage2_capacity));
+        bytes = stage2_offset + (size_t)cfg.processor_count * cfg.strategy_count * stage2_stride;
+        // FNV-1a over what fixes the layout, so a process started with a
+        // different config refuses to attach.
+        hash = 0xcbf29ce484222325ull;
+        for (uint64_t v : {(uint64_t)cfg.producer_count, (uint64_t)cfg.processor_count, (uint64_t)cfg.strategy_count,
+                           (uint64_t)cfg.stage1_capacity, (uint64_t)cfg.stage2_capacity, (uint64_t)sizeof(Message),
+                           (uint64_t)sizeof(ShmControl), (uint64_t)bytes})
+            hash = (hash ^ v) * 0x100000001b3ull;
+    }
+
+    size_t stage1_ring(int producer, int processor) const {
+        return stage1_offset + ((size_t)producer * processors + processor) * stage1_stride;
+    }
+    size_t stage2_ring(int processor, int strategy) const {
+        return stage2_offset + ((size_t)processor * strategies + strategy) * stage2_stride;
+    }
+    static size_t slots(size_t ring) { return ring + (sizeof(ShmRingHeader) + SHM_PAGE - 1) / SHM_PAGE * SHM_PAGE; }
+};
+
+// This process's views of the stage-1 rings. Each one is only used by the
+// side this process runs; size() is what Stage1Balancer reads.
+class ShmStage1 {
+public:
+    ShmStage1(uint8_t* base, const ShmLayout& layout, int producers) : processors_(layout.processors) {
+        for (int p = 0; p < producers; ++p)
+            for (int q = 0; q < layout.processors; ++q) lanes_.emplace_back(base, layout.stage1_ring(p, q));
+    }
+
+    ShmSPSCQueue<Message>& lane(int producer, int processor) { return lanes_[producer * processors_ + processor]; }
+
+    size_t size(int processor) const {
+        size_t total = 0;
+        for (size_t i = processor; i < lanes_.size(); i += processors_) total += lanes_[i].size();
+        return total;
+    }
+
+private:
+    int processors_;
+    std::vector<ShmSPSCQueue<Message>> lanes_;
+};
+
+// Registration of this process's threads in the control block, undone on
+// exit. Only a run that has not started yet can be joined.
+class ShmAttachment {
+public:
+    ShmAttachment(ShmSegment& segment, ShmControl& control, ShmRole role, const std::vector<int>& threads)
+        : segment_(segment), control_(control), role_((int)role), threads_(threads) {
+        control_.processes.fetch_add(1, std::memory_order_acq_rel);
+        const int32_t self = getpid();
+        for (int idx : threads_) {
+            int32_t expected = 0;
+            if (!control_.pid[role_][idx].compare_exchange_strong(expected, self)) {
+                const bool alive = kill(expected, 0) == 0 || errno == EPERM;
+                release(); // on the threads registered so far
+                throw std::runtime_error(std::string(shm_role_name(role)) + " " + std::to_string(idx) +
+                                         (alive ? " is already attached by pid " + std::to_string(expected)
+                                                : " was attached by pid " + std::to_string(expected) +
+                                                      ", which is gone: " + segment_.name() +
+                                                      " is left over from an earlier run, remove /dev/shm" +
+                                                      segment_.name()));
+            }
+            registered_.push_back(idx);
+        }
+        control_.attached[role_].fetch_add((int)threads_.size(), std::memory_order_acq_rel);
+        counted_ = true;
+        if (control_.start_ns.load(std::memory_order_acquire) != 0) {
+            release();
+            throw std::runtime_error("The run in " + segment_.name() + " has already started");
+        }
+    }
+
+    ~ShmAttachment() { release(); }
+
+    // Once the run has started the registration stays, so nobody can take
+    // a thread's place.
+    void keep() { kept_ = true; }
+
+private:
+    void release() {
+        if (!kept_) {
+            for (int idx : registered_) control_.pid[role_][idx].store(0, std::memory_order_release);
+            if (counted_) control_.attached[role_].fetch_sub((int)threads_.size(), std::memory_order_acq_rel);
+        }
+        registered_.clear();
+        counted_ = false;
+        if (!left_ && control_.processes.fetch_sub(1, std::memory_order_acq_rel) == 1) segment_.unlink();
+        left_ = true;
+    }
+
+    ShmSegment& segment_;
+    ShmControl& control_;
+    int role_;
+    std::vector<int> threads_;
+    std::vector<int> registered_;
+    bool counted_ = false;
+    bool kept_ = false;
+    bool left_ = false;
+};
+
+// Runs this process's share of the pipeline and writes its summary and
+// results record; returns the process exit code.
+static int run_role(const Config& cfg, ShmRole role, int index, const std::string& scenario,
+                    const std::string& results_dir) {
+    if (std::string why = shm_unsupported(cfg); !why.empty())
+        throw std::runtime_error("Not supported across processes: " + why);
+    const int counts[SHM_ROLES] = {cfg.producer_count, cfg.processor_count, cfg.strategy_count};
+    const int r = (int)role;
+    if (index >= counts[r])
+        throw std::runtime_error("--index " + std::to_string(index) + " but the config has " +
+                                 std::to_string(counts[r]) + " " + shm_role_name(role) + " threads");
+    std::vector<int> threads;
+    for (int i = 0; i < counts[r]; ++i)
+        if (index < 0 || i == index) threads.push_back(i);
+    if (cfg.stage1_ingress != IngressTopology::Lanes)
+        std::cerr << "Note: stage1_ingress " << ingress_topology_name(cfg.stage1_ingress)
+                  << " is in-process only; shared memory always uses lanes\n";
+    WaitKind wait_kind = r == 0 ? cfg.wait.producer : r == 1 ? cfg.wait.processor : cfg.wait.strategy;
+    if (wait_kind == WaitKind::Park) {
+        std::cerr << "Note: park sleeps on process-private futexes; " << shm_role_name(role)
+                  << " threads yield instead\n";
+        wait_kind = WaitKind::Yield;
+    }
+
+    const TscCalibration tsc = process_tsc();
+    const Clock clock(parse_clock_source(cfg.clock), tsc);
+    const std::string name = cfg.shm_name.empty() ? "/router_" + scenario : cfg.shm_name;
+    const auto timeout = std::chrono::milliseconds(cfg.shm_attach_timeout_ns / 1000000);
+    const ShmLayout layout(cfg);
+    ShmSegment segment(name, layout.bytes, timeout);
+    uint8_t* base = segment.base();
+    ShmControl& control = *reinterpret_cast<ShmControl*>(base);
+    if (segment.created()) {
+        // The pages are fresh zeros: only the magic word orders the layout.
+        control.layout_hash = layout.hash;
+        try {
+            for (int p = 0; p < cfg.producer_count; ++p)
+                for (int q = 0; q < cfg.processor_count; ++q)
+                    ShmSPSCQueue<Message>::init(base, layout.stage1_ring(p, q),
+                                                ShmLayout::slots(layout.stage1_ring(p, q)), cfg.stage1_capacity);
+            for (int q = 0; q < cfg.processor_count; ++q)
+                for (int s = 0; s < cfg.strategy_count; ++s)
+                    ShmSPSCQueue<Message>::init(base, layout.stage2_ring(q, s),
+                                                ShmLayout::slots(layout.stage2_ring(q, s)), cfg.stage2_capacity);
+        } catch (...) {
+            segment.unlink();
+            throw;
+        }
+        control.magic.store(SHM_MAGIC, std::memory_order_release);
+    } else {
+        const uint64_t give_up = clock.now() + cfg.shm_attach_timeout_ns;
+        while (control.magic.load(std::memory_order_acquire) != SHM_MAGIC) {
+            if (clock.now() > give_up) throw std::runtime_error("Shared memory " + name + " was never initialised");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (control.layout_hash != layout.hash)
+            throw std::runtime_error("Shared memory " + name + " was laid out for a different config");
+    }
+    ShmAttachment attachment(segment, control, role, threads);
+    std::cout << "Scenario " << scenario << ": " << shm_role_name(role) << " process " << getpid() << " "
+              << (segment.created() ? "created" : "attached to") << " " << name << " (" << layout.bytes / 1024
+              << " KiB)" << std::endl;
+
+    // Start: the first thread to see every role attached stamps the start.
+    const uint64_t give_up = clock.now() + cfg.shm_attach_timeout_ns;
+    for (;;) {
+        if (control.start_ns.load(std::memory_order_acquire)) break;
+        bool all = true;
+        for (int k = 0; k < SHM_ROLES; ++k) all &= control.attached[k].load(std::memory_order_acquire) == counts[k];
+        uint64_t expected = 0;
+        if (all && control.start_ns.compare_exchange_strong(expected, clock.now())) break;
+        if (clock.now() > give_up) {
+            std::string have;
+            for (int k = 0; k < SHM_ROLES; ++k)
+                have += std::string(k ? ", " : "") + shm_role_name((ShmRole)k) + " " +
+                        std::to_string(control.attached[k].load()) + "/" + std::to_string(counts[k]);
+            throw std::runtime_error("Timed out waiting for the other roles to attach (" + have + ")");
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    attachment.keep();
+    const uint64_t start_ns = control.start_ns.load(std::memory_order_acquire);
+    const uint64_t measure_from = start_ns + cfg.warmup_secs * 1000000000ull;
+    const uint64_t end_ns = measure_from + cfg.duration_secs * 1000000000ull;
+
+    // A thread of role k is done once it has finished or its process is gone;
+    // the kill() probe runs at most every kLivenessNs per caller.
+    constexpr uint64_t kLivenessNs = 100000000;
+    std::mutex lost_mutex;
+    std::vector<std::string> lost;
+    auto gone = [&](int k, int idx) {
+        if (control.finished[k][idx].load(std::memory_order_acquire)) return false;
+        int32_t pid = control.pid[k][idx].load(std::memory_order_acquire);
+        if (pid == 0 || kill(pid, 0) == 0 || errno != ESRCH) return false;
+        std::lock_guard<std::mutex> lock(lost_mutex);
+        std::string what = std::string(shm_role_name((ShmRole)k)) + " " + std::to_string(idx) + " (pid " +
+                           std::to_string(pid) + ")";
+        if (std::find(lost.begin(), lost.end(), what) == lost.end()) {
+            std::cerr << "Warning: " << what << " exited without finishing\n";
+            lost.push_back(what);
+        }
+        return true;
+    };
+    struct Liveness {
+        uint64_t next_probe = 0;
+    };
+    auto role_done = [&](int k, Liveness& live) {
+        const bool probe = clock.now() >= live.next_probe;
+        if (probe) live.next_probe = clock.now() + kLivenessNs;
+        for (int i = 0; i < counts[k]; ++i)
+            if (!control.finished[k][i].load(std::memory_order_acquire) && !(probe && gone(k, i))) return false;
+        return true;
+    };
+
+    RoutingTables tables(cfg);
+    const DynamicRouting routing(cfg, tables);
+    ShmStage1 stage1(base, layout, cfg.producer_count);
+    std::vector<ShmSPSCQueue<Message>> stage2;
+    for (int q = 0; q < cfg.processor_count; ++q)
+        for (int s = 0; s < cfg.strategy_count; ++s) stage2.emplace_back(base, layout.stage2_ring(q, s));
+    auto stage2_lane = [&](int q, int s) -> ShmSPSCQueue<Message>& { return stage2[q * cfg.strategy_count + s]; };
+
+    // Strategies run per_message here, so every call handles one message.
+    std::vector<uint64_t> processor_cost_ticks, strategy_cost_ticks;
+    for (auto ns : cfg.processor_cost_ns) processor_cost_ticks.push_back(tsc.to_ticks(ns));
+    for (int s = 0; s < cfg.strategy_count; ++s)
+        strategy_cost_ticks.push_back(tsc.to_ticks(cfg.strategy_call_overhead_ns[s] + cfg.strategy_cost_ns[s]));
+    const AliasTable type_table(cfg.type_weights);
+
+    struct alignas(64) RoleStats {
+        uint64_t messages = 0;
+        uint64_t full_waits = 0;
+        uint64_t out_of_order = 0;
+        uint64_t cpu_ns = 0;
+        bool cut_short = false; // a downstream peer went away
+        std::unique_ptr<StageLatencies> latencies = std::make_unique<StageLatencies>();
+    };
+    std::vector<RoleStats> stats(threads.size());
+    std::vector<ParkingSpot> spots(threads.size()); // never parked on: wait_kind is at most yield
+
+    auto run_thread = [&](size_t slot) {
+        const int idx = threads[slot];
+        RoleStats& st = stats[slot];
+        const auto& cores = r == 0 ? cfg.placement.producers : r == 1 ? cfg.placement.processors
+                                                                       : cfg.placement.strategies;
+        int cpu = Placement::core_for(cores, idx);
+        if (!pin_current_thread(cpu))
+            std::cerr << "Warning: could not pin " << shm_role_name(role) << " " << idx << " to CPU " << cpu << "\n";
+        Waiter wait(wait_kind, spots[slot]);
+        Liveness live;
+
+        if (role == ShmRole::Producer) {
+            Xoshiro256 rng(idx + 1), tape_rng(idx + 1);
+            std::vector<uint8_t> tape(cfg.type_source == TypeSource::Tape ? cfg.tape_length : 1);
+            for (auto& type : tape) type = type_table.sample(tape_rng());
+            const size_t tape_mask = tape.size() - 1;
+            const bool intended_origin = cfg.latency_origin == LatencyOrigin::Intended;
+            Pacer pacer(cfg.rate, clock, start_ns, false, intended_origin ? Pacer::kNoLagLimit : Pacer::kMaxLagNs);
+            Stage1Balancer balancer(cfg.stage1_routing, stage1, idx);
+            std::array<uint32_t, MAX_MSG_TYPES> seq{};
+            uint64_t count = 0;
+            Message msg{};
+            while (clock.now() < end_ns && !st.cut_short) {
+                msg.msg_type = cfg.type_source == TypeSource::Tape ? tape[count++ & tape_mask] : type_table.sample(rng());
+                msg.producer_id = idx;
+                msg.flags = 0;
+                msg.sequence = seq[msg.msg_type]++;
+                const uint64_t intended_ns = pacer.wait_next();
+                msg.timestamp_ns = intended_origin ? intended_ns : clock.now();
+                int proc_id = routing.fixed_processor(msg.msg_type);
+                if (proc_id < 0) proc_id = balancer.pick(msg.msg_type);
+                auto& lane = stage1.lane(idx, proc_id);
+                while (!lane.push(msg)) {
+                    ++st.full_waits;
+                    if (clock.now() >= live.next_probe) {
+                        live.next_probe = clock.now() + kLivenessNs;
+                        if (gone(1, proc_id)) {
+                            st.cut_short = true;
+                            break;
+                        }
+                    }
+                    wait.idle([] { return false; });
+                }
+                wait.reset();
+                if (!st.cut_short) ++st.messages;
+            }
+        } else if (role == ShmRole::Processor) {
+            std::array<Message, MAX_BATCH> batch;
+            Stage2Outbox outbox(cfg.strategy_count);
+            size_t next_lane = 0;
+            // Round-robin over the producers' lanes, as SPSCLaneSet does.
+            auto pull = [&] {
+                size_t n = 0;
+                for (int i = 0; i < cfg.producer_count && n < (size_t)cfg.processor_batch; ++i) {
+                    size_t p = (next_lane + i) % cfg.producer_count;
+                    size_t got = stage1.lane(p, idx).pop_bulk(batch.data() + n, cfg.processor_batch - n);
+                    if (got) {
+                        n += got;
+                        next_lane = p + 1;
+                    }
+                }
+                return n;
+            };
+            for (;;) {
+                size_t n = pull();
+                if (n == 0) {
+                    // The finished flags are read before the lanes are checked
+                    // again, so lanes empty after that hold nothing more.
+                    if (role_done(0, live) && stage1.size(idx) == 0) break;
+                    wait.idle([] { return false; });
+                    continue;
+                }
+                wait.reset();
+                uint64_t t_now = clock.now();
+                uint64_t batch_tsc = read_tsc();
+                uint64_t elapsed = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    Message& msg = batch[i];
+                    uint64_t begin = elapsed;
+                    if (uint64_t cost = processor_cost_ticks[msg.msg_type]) {
+                        busy_work(cost);
+                        elapsed = read_tsc() - batch_tsc;
+                    }
+                    msg.processor_id = idx;
+                    msg.dequeued_offset_ns = offset_ns(t_now + tsc.to_ns(begin), msg.timestamp_ns);
+                    msg.processed_offset_ns = offset_ns(t_now + tsc.to_ns(elapsed), msg.timestamp_ns);
+                    outbox.route(routing, msg);
+                }
+                // Only what reached a lane counts once a strategy has gone.
+                size_t forwarded = 0;
+                for (int sid = 0; sid < cfg.strategy_count; ++sid) {
+                    std::span<Message> box = outbox.take(sid);
+                    auto& lane = stage2_lane(idx, sid);
+                    size_t sent = 0;
+                    while (sent < box.size() && !st.cut_short) {
+                        sent += lane.push_bulk(box.data() + sent, box.size() - sent);
+                        if (sent == box.size()) break;
+                        ++st.full_waits;
+                        if (clock.now() >= live.next_probe) {
+                            live.next_probe = clock.now() + kLivenessNs;
+                            st.cut_short = gone(2, sid);
+                        }
+                        wait.idle([] { return false; });
+                    }
+                    wait.reset();
+                    forwarded += sent;
+                }
+                st.messages += forwarded;
+                if (st.cut_short) break;
+            }
+        } else {
+            std::array<Message, MAX_BATCH> batch;
+            OrderChecker order(cfg.producer_count);
+            StageLatencies& lat = *st.latencies;
+            const uint64_t cost = strategy_cost_ticks[idx];
+            size_t next_lane = 0;
+            auto pending = [&] {
+                size_t total = 0;
+                for (int q = 0; q < cfg.processor_count; ++q) total += stage2_lane(q, idx).size();
+                return total;
+            };
+            for (;;) {
+                size_t n = 0;
+                for (int i = 0; i < cfg.processor_count && n < (size_t)cfg.strategy_batch; ++i) {
+                    size_t q = (next_lane + i) % cfg.processor_count;
+                    size_t got = stage2_lane(q, idx).pop_bulk(batch.data() + n, cfg.strategy_batch - n);
+                    if (got) {
+                        n += got;
+                        next_lane = q + 1;
+                    }
+                }
+                if (n == 0) {
+                    if (role_done(1, live) && pending() == 0) break;
+                    wait.idle([] { return false; });
+                    continue;
+                }
+                wait.reset();
+                uint64_t t_end = clock.now();
+                uint64_t batch_tsc = read_tsc();
+                uint64_t elapsed = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    const Message& msg = batch[i];
+                    order.check(msg);
+                    uint64_t start = t_end + tsc.to_ns(elapsed);
+                    if (cost) {
+                        busy_work(cost);
+                        elapsed = read_tsc() - batch_tsc;
+                    }
+                    if (msg.timestamp_ns < measure_from) continue;
+                    uint64_t done = t_end + tsc.to_ns(elapsed);
+                    uint64_t processed = msg.timestamp_ns + msg.processed_offset_ns;
+                    lat.stage1.record(msg.dequeued_offset_ns);
+                    lat.processing.record(msg.processed_offset_ns - msg.dequeued_offset_ns);
+                    lat.stage2.record(start - processed);
+                    lat.strategy.record(done - start);
+                    lat.total.record(done - msg.timestamp_ns);
+                }
+                st.messages += n;
+            }
+            st.out_of_order = order.violations();
+        }
+        st.cpu_ns = thread_cpu_ns();
+        control.finished[r][idx].store(1, std::memory_order_release);
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t slot = 0; slot < threads.size(); ++slot) workers.emplace_back(run_thread, slot);
+    for (auto& t : workers) t.join();
+    const double run_secs = (clock.now() - start_ns) / 1e9;
+    // Once every thread has finished or died nobody will map the name again
+    // (a started run takes no newcomers), whatever the process count says.
+    bool all_over = true;
+    for (int k = 0; k < SHM_ROLES; ++k)
+        for (int i = 0; i < counts[k]; ++i) all_over &= control.finished[k][i].load() || gone(k, i);
+    if (all_over) segment.unlink();
+
+    // ---- Results ----
+    std::string label = scenario + "_" + shm_role_name(role) + (index >= 0 ? "_" + std::to_string(index) : "");
+    std::ofstream summary_file(results_dir + "/" + label + "_summary.txt");
+    summary_file << "Scenario: " << scenario << " | Role: " << shm_role_name(role) << " | Process: " << getpid()
+                 << " | Segment: " << name << " (" << layout.bytes / 1024 << " KiB, "
+                 << (segment.created() ? "created" : "attached") << ")\n";
+    std::ostringstream run_time;
+    run_time << std::fixed << std::setprecision(3) << run_secs << " s";
+    summary_file << "Run: " << run_time.str() << " (warm-up " << cfg.warmup_secs << " s, measure " << cfg.duration_secs
+                 << " s) | Clock: " << clock_source_name(clock.source()) << "\n";
+    const char* verb = r == 0 ? "Sent" : r == 1 ? "Processed" : "Delivered";
+    nlohmann::ordered_json per_thread = nlohmann::ordered_json::array();
+    StageLatencies latencies;
+    uint64_t total = 0, out_of_order = 0;
+    for (size_t slot = 0; slot < threads.size(); ++slot) {
+        const RoleStats& st = stats[slot];
+        total += st.messages;
+        out_of_order += st.out_of_order;
+        latencies.merge(*st.latencies);
+        summary_file << shm_role_name(role) << " " << threads[slot] << " | " << verb << ": " << st.messages
+                     << " | Full waits: " << st.full_waits << " | CPU: " << st.cpu_ns / 1e9 << " s";
+        if (role == ShmRole::Strategy) summary_file << " | Out-of-order: " << st.out_of_order;
+        if (st.cut_short) summary_file << " | cut short (downstream gone)";
+        summary_file << "\n";
+        per_thread.push_back({{"index", threads[slot]}, {"messages", st.messages}, {"full_waits", st.full_waits},
+                              {"cpu_s", st.cpu_ns / 1e9}, {"cut_short", st.cut_short}});
+        if (role == ShmRole::Strategy) per_thread.back()["out_of_order"] = st.out_of_order;
+    }
+    summary_file << "Total " << verb << ": " << total << " (" << total / std::max(run_secs, 1e-9)
+                 << " msgs/s over the run)\n";
+    nlohmann::ordered_json latency_json;
+    if (role == ShmRole::Strategy) {
+        write_stage_percentiles(summary_file, latencies);
+        latency_json = stage_percentiles_json(latencies);
+    }
+    for (const auto& what : lost) summary_file << "Lost: " << what << " exited without finishing\n";
+
+    nlohmann::ordered_json record = {
+        {"scenario", scenario},     {"role", shm_role_name(role)}, {"pid", getpid()},
+        {"segment", name},          {"run_s", run_secs},           {"messages", total},
+        {"threads", per_thread},    {"latency_us", latency_json},  {"lost_peers", lost}};
+    if (role == ShmRole::Strategy) record["out_of_order"] = out_of_order;
+    std::ofstream(results_dir + "/" + label + ".json") << record.dump(2) << "\n";
+    std::cout << "Scenario " << scenario << ": " << shm_role_name(role) << " done, " << total << " messages. Results in "
+              << results_dir << "/" << label << "_summary.txt" << std::endl;
+    return lost.empty() ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    auto usage = [&] {
+        std::cerr << "Usage: " << argv[0] << " <config.json|config_dir>... <results_dir>\n"
+                  << "       " << argv[0] << " --emit-topology <config.json> <header.hpp>\n"
+                  << "       " << argv[0]
+                  << " --role producer|processor|strategy [--index N] <config.json> <results_dir>\n";
+        return 1;
+    };
+    if (argc == 4 && std::string(argv[1]) == "--emit-topology") {
+        Config cfg = load_config(argv[2]);
+        std::ofstream out(argv[3]);
+        emit_topology(cfg, argv[2], out);
+        std::cout << "Static topology for " << argv[2] << " written to " << argv[3] << std::endl;
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--role") {
+        const bool indexed = argc == 7 && std::string(argv[3]) == "--index";
+        if (argc != 5 && !indexed) return usage();
+        const std::filesystem::path config = argv[indexed ? 5 : 3];
+        const std::string results_dir = argv[indexed ? 6 : 4];
+        try {
+            ShmRole role = parse_shm_role(argv[2]);
+            int index = indexed ? std::stoi(argv[4]) : -1;
+            std::filesystem::create_directories(results_dir);
+            return run_role(load_config(config.string()), role, index, config.stem().string(), results_dir);
+        } catch (const std::exception& e) {
+            std::cerr << "Role " << argv[2] << " failed: " << e.what() << "\n";
+            return 1;
+        }
+    }
+    if (argc < 3) return usage();
+
+    // Every argument but the last is a config or a directory of them.
+    std::vector<std::filesystem::path> config_paths;
+    for (int i = 1; i < argc - 1; ++i) {
+        std::filesystem::path arg = argv[i];
+        if (!std::filesystem::is_directory(arg)) {
+            config_paths.push_back(arg);
+            continue;
+        }
+        std::vector<std::filesystem::path> found;
+        for (auto& entry : std::filesystem::directory_iterator(arg))
+            if (entry.is_regular_file() && entry.path().extension() == ".json") found.push_back(entry.path());
+        std::sort(found.begin(), found.end());
+        config_paths.insert(config_paths.end(), found.begin(), found.end());
+    }
+    if (config_paths.empty()) {
+        std::cerr << "No configs given\n";
+        return 1;
+    }
+    std::string results_dir = argv[argc - 1];
+    std::filesystem::create_directories(results_dir);
+
+    // Batch runs keep threads and queue memory from one scenario to the next;
+    // a failing scenario is recorded and the batch goes on.
+    if (config_paths.size() > 1) ring_mappings.enable();
+    WorkerPool workers;
+    nlohmann::ordered_json results = {{"scenarios", nlohmann::ordered_json::array()}};
+    int failed = 0;
+    for (auto& path : config_paths) {
+        std::string scenario = path.stem().string();
+        try {
+            Config cfg = load_config(path.string());
+            ScenarioOutputs out(results_dir, scenario, cfg.metrics_jsonl);
+            results["scenarios"].push_back(run_config(cfg, scenario, out, workers));
+        } catch (const std::exception& e) {
+            std::cerr << "Scenario " << scenario << " failed: " << e.what() << "\n";
+            results["scenarios"].push_back({{"scenario", scenario}, {"error", e.what()}});
+            ++failed;
+        }
+        std::ofstream(results_dir + "/results.json") << results.dump(2) << "\n";
+    }
+    return failed ? 1 : 0;
 }